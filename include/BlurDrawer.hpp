@@ -0,0 +1,84 @@
+#ifndef BLUR_DRAWER_HPP
+#define BLUR_DRAWER_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "PixelFormat.hpp"
+
+#include <mutex>
+#include <vector>
+
+// Censures the faces of a frame, used by process C and the benchmarks.
+// Mode 0 fills every face with a solid rectangle, mode 1 blurs it.
+class BlurDrawer {
+private:
+    cv::Mat image;
+    std::vector<cv::Rect> face_list;
+    int mode;//blur mode
+    std::mutex mode_mutex;
+
+    static const int DEFAULT_MODE = 0;
+
+public:
+    BlurDrawer(cv::Mat input_image, std::vector<cv::Rect> list, int x);
+
+    cv::Mat draw();
+
+    int get_mode(){
+        mode_mutex.lock();
+        int copy = mode;
+        mode_mutex.unlock();
+        return copy;
+    }
+    void set_mode(int new_mode){
+        mode_mutex.lock();
+        mode = new_mode;
+        mode_mutex.unlock();
+    }
+
+    //frames in a native format are converted to BGR instead of copied, the only conversion they go through in C
+    void set_draw_info(cv::Mat input_image, std::vector<cv::Rect> list, int pixel_format = PIXEL_BGR) {
+        face_list = std::move(list);
+        //always a new image, the previous one may still be displayed
+        cv::Mat copy;
+        to_bgr(input_image, pixel_format, copy);
+        image = copy;
+    }
+    BlurDrawer(){
+        mode = DEFAULT_MODE;
+    }
+};
+
+
+inline BlurDrawer::BlurDrawer(cv::Mat input_image, std::vector<cv::Rect> list, int x) {
+
+    face_list = std::move(list);
+    image = input_image.clone();
+    mode = x;
+}
+
+inline cv::Mat BlurDrawer::draw() {
+    //fill face rect
+     if( mode == 0) {
+
+         cv::Scalar color(0, 0, 0);//red
+         
+         int frame_thickness = -1;//fill
+         for (const auto &r : face_list) {
+
+            cv::rectangle(image, r, color, frame_thickness);   
+
+         }
+         //add gaussian blur on face rect
+     } else if (mode == 1) {
+         for (const auto &r : face_list) {
+             //increasing sigma X val strengthen blur
+             cv::GaussianBlur(image(r), image(r), cv::Size(0,0), 11);
+         }
+     }
+    return image;
+
+}
+
+#endif // !BLUR_DRAWER_HPP
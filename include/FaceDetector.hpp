@@ -0,0 +1,345 @@
+#ifndef FACE_DETECTOR_HPP
+#define FACE_DETECTOR_HPP
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/dnn.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+// Precision, dnn backend and target used for inference, see SsdFaceDetector::set_inference_mode()
+struct InferenceMode {
+    //fp32, fp16 or int8
+    std::string precision = "fp32";
+    //opencv, default, openvino or cuda
+    std::string backend = "opencv";
+    //cpu, opencl or opencl_fp16, empty means the target follows the precision
+    std::string target;
+    //int8: quantize the network on calibration frames instead of loading a model file that is quantized already
+    bool quantize = false;
+};
+
+
+// Interface of all face detection backends.
+// Faces of a frame are returned as a flat list: its size first and then x, y, width and height of every face,
+// since primitive values are what we put into shmem.
+class FaceDetector {
+
+public:
+    virtual ~FaceDetector() = default;
+
+    //return list of detected faces
+    std::vector<int> detected_face(const cv::Mat &frame) {
+        return detected_faces(std::vector<cv::Mat>{frame})[0];
+    }
+
+    //detect faces in several frames, returns one list per frame
+    virtual std::vector<std::vector<int>> detected_faces(const std::vector<cv::Mat> &frames) = 0;
+
+    //change the size frames are scaled to before detection
+    virtual void set_input_size(int size) = 0;
+    virtual int get_input_size() const = 0;
+
+    //size a frame of the given size is scaled to before detection, frames already of that size are not scaled again
+    virtual cv::Size detection_size(const cv::Size &frame) const = 0;
+
+    //false if the model could not be loaded
+    virtual bool loaded() const = 0;
+
+    //choose how inference is run, calibration frames are needed only to quantize a network to int8;
+    //returns description of the mode actually used
+    virtual std::string set_inference_mode(const InferenceMode &mode, const std::vector<cv::Mat> &calibration) {
+        return "not applicable";
+    }
+
+protected:
+    static void push_face(std::vector<int> &faces, const cv::Rect &face) {
+        //we store x,y of left bottom pixel, width and height
+        faces.push_back(face.x);
+        faces.push_back(face.y);
+        faces.push_back(face.width);
+        faces.push_back(face.height);
+    }
+
+    //insert size of array as first element so process C can read it
+    static void finish_list(std::vector<int> &faces) {
+        faces.insert(faces.begin(), faces.size());
+    }
+};
+
+
+// SSD network with a DetectionOutput layer (res10 face detector), loaded from Caffe or ONNX files.
+// The ONNX model is expected to keep the SSD output layout: [1, 1, N, 7] rows of
+// (image id, class, confidence, x1, y1, x2, y2) with coordinates relative to the frame size.
+class SsdFaceDetector : public FaceDetector {
+
+private:
+    cv::dnn::Net detection_network;
+    //names of the input and output layers, empty means the first input and the last output
+    std::string input_name;
+    std::string output_name;
+
+    int image_width;
+    int image_height;
+    int image_scale;
+    //mean values network was trained with
+    cv::Scalar mean_val;
+    //confidence (default 0.5)
+    float confidence_threshold;
+
+public:
+    SsdFaceDetector(cv::dnn::Net network, const std::string &input, const std::string &output, float confidence) :
+            detection_network(network),
+            input_name(input),
+            output_name(output),
+            image_width(300),
+            image_height(300),
+            image_scale(1.0),
+            //values model was trained with
+            mean_val({104., 177.0, 123.0}),
+            //increasing confidence val is not recommended, deacreasing will cause false-positves
+            confidence_threshold(confidence) {
+        if (detection_network.empty()) {
+            std::cerr<<"ERROR: could not read network" << std::endl;
+        }
+    }
+
+    std::vector<std::vector<int>> detected_faces(const std::vector<cv::Mat> &frames) override {
+        //transform frames to a single data blop (resize and rescale every img)
+        cv::Mat input_blob = cv::dnn::blobFromImages(frames, image_scale, cv::Size(image_width, image_height), mean_val, false, false);
+
+        //forward blop through network and save data in detection_matrix
+        detection_network.setInput(input_blob, input_name);
+        cv::Mat detection = detection_network.forward(output_name);
+        cv::Mat detection_matrix(detection.size[2], detection.size[3], CV_32F, detection.ptr<float>());
+
+        std::vector<std::vector<int>> faces(frames.size());
+
+        for (int i = 0; i < detection_matrix.rows; i++) {
+            //detections of all frames in the batch come in one matrix, the first column tells which frame it belongs to
+            int image_id = static_cast<int>(detection_matrix.at<float>(i, 0));
+            float confidence = detection_matrix.at<float>(i, 2);
+
+            if (image_id >= 0 && image_id < (int)frames.size() && confidence > confidence_threshold) {
+                const cv::Mat &frame = frames[image_id];
+                //left bottom pixel
+                int x1 = static_cast<int>(detection_matrix.at<float>(i, 3) * frame.cols);
+                int y1 = static_cast<int>(detection_matrix.at<float>(i, 4) * frame.rows);
+
+                //right top pixel
+                int x2 = static_cast<int>(detection_matrix.at<float>(i, 5) * frame.cols);
+                int y2 = static_cast<int>(detection_matrix.at<float>(i, 6) * frame.rows);
+
+                push_face(faces[image_id], cv::Rect(x1, y1, x2 - x1, y2 - y1));
+            }
+
+        }
+        for (auto &list : faces)
+            finish_list(list);
+        return faces;
+    }
+
+    void set_input_size(int size) override {
+        image_width = size;
+        image_height = size;
+    }
+
+    int get_input_size() const override {
+        return image_width;
+    }
+
+    cv::Size detection_size(const cv::Size &frame) const override {
+        return cv::Size(image_width, image_height);
+    }
+
+    bool loaded() const override {
+        return !detection_network.empty();
+    }
+
+    std::string set_inference_mode(const InferenceMode &mode, const std::vector<cv::Mat> &calibration) override {
+        int backend = cv::dnn::DNN_BACKEND_OPENCV;
+        if (mode.backend == "default")
+            backend = cv::dnn::DNN_BACKEND_DEFAULT;
+        else if (mode.backend == "openvino")
+            backend = cv::dnn::DNN_BACKEND_INFERENCE_ENGINE;
+        else if (mode.backend == "cuda")
+            backend = cv::dnn::DNN_BACKEND_CUDA;
+
+        int target = cv::dnn::DNN_TARGET_CPU;
+        std::string used = mode.precision;
+
+        if (mode.precision == "fp16") {
+            //CV_CPU_FP16 only means F16C conversions on x86, where OpenCV runs DNN_TARGET_CPU_FP16 in fp32;
+            //fp16 arithmetic on the CPU needs the fp16 extension of ARMv8.2 NEON
+#if (CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)) && defined(__aarch64__) && defined(CV_CPU_NEON_FP16)
+            if (cv::checkHardwareSupport(CV_CPU_NEON_FP16))
+                target = cv::dnn::DNN_TARGET_CPU_FP16;
+            else
+#endif
+            if (backend == cv::dnn::DNN_BACKEND_CUDA)
+                target = cv::dnn::DNN_TARGET_CUDA_FP16;
+            else if (cv::ocl::haveOpenCL())
+                target = cv::dnn::DNN_TARGET_OPENCL_FP16;
+            else {
+                std::cerr << "fp16 inference is not supported on this machine, using fp32" << std::endl;
+                used = "fp32";
+            }
+        } else if (mode.precision == "int8") {
+            if (!mode.quantize) {
+                //the model file itself is expected to be quantized (e.g. int8 onnx)
+                used = "int8 (quantized model)";
+            } else if (calibration.empty()) {
+                std::cerr << "int8 quantization requires calibration frames, using fp32" << std::endl;
+                used = "fp32";
+            } else {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && (CV_VERSION_MINOR > 5 || (CV_VERSION_MINOR == 5 && CV_VERSION_REVISION >= 4)))
+                //quantize weights and activations with ranges observed on calibration frames, inputs and outputs stay fp32
+                cv::Mat calibration_blob = cv::dnn::blobFromImages(calibration, image_scale, cv::Size(image_width, image_height), mean_val, false, false);
+                detection_network = detection_network.quantize(calibration_blob, CV_32F, CV_32F);
+                used = "int8 (quantized with " + std::to_string(calibration.size()) + " frames)";
+                //quantized layers are implemented only on the CPU by the OpenCV backend
+                backend = cv::dnn::DNN_BACKEND_OPENCV;
+#else
+                std::cerr << "int8 quantization requires OpenCV 4.5.4, using fp32" << std::endl;
+                used = "fp32";
+#endif
+            }
+        } else if (backend == cv::dnn::DNN_BACKEND_CUDA) {
+            target = cv::dnn::DNN_TARGET_CUDA;
+        }
+
+        //explicitly chosen target overrides the one following from precision
+        if (mode.target == "cpu")
+            target = cv::dnn::DNN_TARGET_CPU;
+        else if (mode.target == "opencl")
+            target = cv::dnn::DNN_TARGET_OPENCL;
+        else if (mode.target == "opencl_fp16")
+            target = cv::dnn::DNN_TARGET_OPENCL_FP16;
+
+        //on any other target fp16 runs as fp32, report what actually runs
+        if (used == "fp16" && target != cv::dnn::DNN_TARGET_OPENCL_FP16 && target != cv::dnn::DNN_TARGET_CUDA_FP16
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+            && target != cv::dnn::DNN_TARGET_CPU_FP16
+#endif
+            ) {
+            std::cerr << "fp16 is not supported by the chosen target, using fp32" << std::endl;
+            used = "fp32";
+        }
+
+        detection_network.setPreferableBackend(backend);
+        detection_network.setPreferableTarget(target);
+
+        std::string target_name = "cpu";
+        if (target == cv::dnn::DNN_TARGET_OPENCL)
+            target_name = "opencl";
+        else if (target == cv::dnn::DNN_TARGET_OPENCL_FP16)
+            target_name = "opencl_fp16";
+        else if (target == cv::dnn::DNN_TARGET_CUDA || target == cv::dnn::DNN_TARGET_CUDA_FP16)
+            target_name = "cuda";
+        else if (target != cv::dnn::DNN_TARGET_CPU)
+            target_name = "cpu_fp16";
+        return used + ", backend " + mode.backend + ", target " + target_name;
+    }
+};
+
+
+// Viola-Jones cascade (Haar or LBP features) bundled with OpenCV.
+// Frames are scaled down so that their longer side equals the input size, which is what the detection cost depends on.
+class CascadeFaceDetector : public FaceDetector {
+
+private:
+    cv::CascadeClassifier classifier;
+    int input_size;
+    //faces smaller than this (in pixels of the scaled frame) are not searched for
+    int min_face;
+
+public:
+    explicit CascadeFaceDetector(const std::string &cascade_file) : input_size(300), min_face(20) {
+        if (!classifier.load(cascade_file)) {
+            std::cerr << "ERROR: could not read cascade " << cascade_file << std::endl;
+        }
+    }
+
+    std::vector<std::vector<int>> detected_faces(const std::vector<cv::Mat> &frames) override {
+        std::vector<std::vector<int>> faces(frames.size());
+        cv::Mat gray, scaled;
+
+        for (size_t f = 0; f < frames.size(); ++f) {
+            const cv::Mat &frame = frames[f];
+            double scale = (double)input_size / std::max(frame.cols, frame.rows);
+            cv::resize(frame, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+            cv::cvtColor(scaled, gray, cv::COLOR_BGR2GRAY);
+            cv::equalizeHist(gray, gray);
+
+            std::vector<cv::Rect> found;
+            classifier.detectMultiScale(gray, found, 1.1, 3, 0, cv::Size(min_face, min_face));
+            for (const auto &r : found)
+                push_face(faces[f], cv::Rect(r.x / scale, r.y / scale, r.width / scale, r.height / scale));
+            finish_list(faces[f]);
+        }
+        return faces;
+    }
+
+    void set_input_size(int size) override {
+        input_size = size;
+    }
+
+    int get_input_size() const override {
+        return input_size;
+    }
+
+    cv::Size detection_size(const cv::Size &frame) const override {
+        double scale = (double)input_size / std::max(frame.width, frame.height);
+        return cv::Size(cvRound(frame.width * scale), cvRound(frame.height * scale));
+    }
+
+    bool loaded() const override {
+        return !classifier.empty();
+    }
+};
+
+
+// Backend and model files chosen at runtime, empty paths select the default model of the backend
+struct DetectorConfig {
+    //caffe, onnx, haar or lbp
+    std::string backend = "caffe";
+    std::string model;
+    std::string config;
+    float confidence = 0.5;
+    //fp32 model a quantized int8 model file is checked against, empty selects the default model of the backend
+    std::string reference_model;
+};
+
+inline std::unique_ptr<FaceDetector> make_face_detector(const DetectorConfig &config) {
+    if (config.backend == "caffe") {
+        //detection network model files (.prototext configuration and .caffemodel binary)
+        //source github.com/spmallick/learnopencv/tree/master/FaceDetectionComparison/models
+        std::string prototxt = config.config.empty() ? FACE_DETECTION_CONFIGURATION : config.config;
+        std::string weights = config.model.empty() ? FACE_DETECTION_WEIGHTS : config.model;
+        return std::unique_ptr<FaceDetector>(new SsdFaceDetector(cv::dnn::readNetFromCaffe(prototxt, weights),
+                                                                 "data", "detection_out", config.confidence));
+    }
+    if (config.backend == "onnx") {
+        if (config.model.empty())
+            std::cerr << "ERROR: onnx backend requires a model file" << std::endl;
+        return std::unique_ptr<FaceDetector>(new SsdFaceDetector(cv::dnn::readNetFromONNX(config.model), "", "", config.confidence));
+    }
+    if (config.backend == "haar") {
+        std::string cascade = config.model.empty() ? OPENCV_DATA_DIR "/haarcascades/haarcascade_frontalface_default.xml" : config.model;
+        return std::unique_ptr<FaceDetector>(new CascadeFaceDetector(cascade));
+    }
+    if (config.backend == "lbp") {
+        std::string cascade = config.model.empty() ? OPENCV_DATA_DIR "/lbpcascades/lbpcascade_frontalface_improved.xml" : config.model;
+        return std::unique_ptr<FaceDetector>(new CascadeFaceDetector(cascade));
+    }
+    std::cerr << "ERROR: unknown detector backend " << config.backend << std::endl;
+    return nullptr;
+}
+
+#endif // !FACE_DETECTOR_HPP
@@ -0,0 +1,264 @@
+#ifndef FRAME_BUFFER_HPP
+#define FRAME_BUFFER_HPP
+
+#include <boost/interprocess/creation_tags.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// mount point of hugetlbfs, frame buffers are created there when huge pages are reserved
+#define HUGETLBFS_DIR "/dev/hugepages"
+// policy of transparent huge pages for shared memory, the selected one is in brackets, e.g. "always within_size [advise] never deny force"
+#define THP_SHMEM_ENABLED "/sys/kernel/mm/transparent_hugepage/shmem_enabled"
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+#ifndef MPOL_MF_MOVE_ALL
+#define MPOL_MF_MOVE_ALL (1 << 2)
+#endif
+
+// pages backing a frame buffer, PAGES_AUTO tries hugetlbfs first and falls back to transparent huge pages
+enum FramePages { PAGES_AUTO, PAGES_TRANSPARENT, PAGES_SMALL };
+
+//size of a huge page from /proc/meminfo, 2 MB when unknown
+inline size_t huge_page_size() {
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kb;
+    while (meminfo >> key) {
+        if (key == "Hugepagesize:" && meminfo >> kb)
+            return kb * 1024;
+        meminfo.ignore(256, '\n');
+    }
+    return 2 * 1024 * 1024;
+}
+
+//whether shared memory advised with MADV_HUGEPAGE gets transparent huge pages: the policy selected in shmem_enabled
+//is not "never" or "deny" (madvise succeeds either way), false when the kernel has no transparent huge pages
+inline bool shmem_thp_enabled() {
+    std::ifstream file(THP_SHMEM_ENABLED);
+    std::string mode;
+    while (file >> mode)
+        if (mode.front() == '[')
+            return mode != "[never]" && mode != "[deny]";
+    return false;
+}
+
+//ranges like "0-3,8-11" used by sysfs cpu lists
+inline std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        if (range.empty())
+            continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+//NUMA node of every online CPU, empty on machines without NUMA information
+inline std::map<int, int> cpu_nodes() {
+    std::map<int, int> nodes;
+    //node ids need not be contiguous, the online ones are listed like cpus
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string ids;
+    if (!online || !std::getline(online, ids))
+        return nodes;
+    for (int node : parse_cpu_list(ids)) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        std::string list;
+        if (!file || !std::getline(file, list))
+            continue;
+        for (int cpu : parse_cpu_list(list))
+            nodes[cpu] = node;
+    }
+    return nodes;
+}
+
+//node holding most of the given CPUs, -1 when unknown
+inline int majority_node(const std::vector<int> &cpus) {
+    std::map<int, int> nodes = cpu_nodes();
+    std::map<int, int> count;
+    int best = -1;
+    for (int cpu : cpus) {
+        if (nodes.count(cpu) == 0)
+            continue;
+        int node = nodes[cpu];
+        if (++count[node] > (best < 0 ? 0 : count[best]))
+            best = node;
+    }
+    return best;
+}
+
+// Shared memory holding the frames of a stream, written by A and read by B and C.
+// Large frames are backed by huge pages to cut TLB misses of the full-frame copies: a file on hugetlbfs when huge
+// pages are reserved (vm.nr_hugepages), otherwise POSIX shared memory with MADV_HUGEPAGE, which gets transparent huge
+// pages when /sys/kernel/mm/transparent_hugepage/shmem_enabled is "advise" or "always".
+// The pages can be placed on a NUMA node, so they are local to the cores of the consumers.
+// The interface follows mapped_region, so it replaces the shared_memory_object + mapped_region pair.
+class FrameBuffer {
+private:
+    void *address;
+    size_t size;
+    std::string kind;
+
+    static std::string huge_path(const char *name) {
+        return std::string(HUGETLBFS_DIR) + "/" + name;
+    }
+
+    static std::string shm_name(const char *name) {
+        return std::string("/") + name;
+    }
+
+    bool map(int fd, size_t bytes, int protection) {
+        void *mapped = mmap(NULL, bytes, protection, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        address = mapped;
+        size = bytes;
+        return true;
+    }
+
+    bool create_hugetlb(const char *name, size_t bytes) {
+        int fd = ::open(huge_path(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd < 0)
+            return false;
+        //hugetlbfs files are sized in whole huge pages, mmap fails when not enough of them are free
+        size_t page = huge_page_size();
+        size_t rounded = (bytes + page - 1) / page * page;
+        if (ftruncate(fd, rounded) != 0)
+            close(fd);
+        else if (map(fd, rounded, PROT_READ | PROT_WRITE)) {
+            kind = "hugetlbfs";
+            return true;
+        }
+        unlink(huge_path(name).c_str());
+        return false;
+    }
+
+    void create_shm(const char *name, size_t bytes, FramePages pages) {
+        int fd = shm_open(shm_name(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0666);
+        if (fd < 0)
+            throw boost::interprocess::interprocess_exception("FrameBuffer: could not create shared memory");
+        size_t rounded = bytes;
+        if (pages != PAGES_SMALL) {
+            size_t page = huge_page_size();
+            rounded = (bytes + page - 1) / page * page;
+        }
+        if (ftruncate(fd, rounded) != 0) {
+            close(fd);
+            throw boost::interprocess::interprocess_exception("FrameBuffer: could not size shared memory");
+        }
+        if (!map(fd, rounded, PROT_READ | PROT_WRITE))
+            throw boost::interprocess::interprocess_exception("FrameBuffer: could not map shared memory");
+        if (pages != PAGES_SMALL && shmem_thp_enabled() && madvise(address, size, MADV_HUGEPAGE) == 0)
+            kind = "transparent huge pages";
+        else {
+            madvise(address, size, MADV_NOHUGEPAGE);
+            kind = "small pages";
+        }
+    }
+
+    void create(const char *name, size_t bytes, int node, FramePages pages) {
+        if (pages != PAGES_AUTO || !create_hugetlb(name, bytes))
+            create_shm(name, bytes, pages);
+        //the policy is set before the first touch, so the pages are allocated on the node right away
+        if (node >= 0)
+            place(node);
+        memset(address, 0, size);
+    }
+
+    bool open(const char *name, boost::interprocess::mode_t mode) {
+        int flags = mode == boost::interprocess::read_only ? O_RDONLY : O_RDWR;
+        int protection = mode == boost::interprocess::read_only ? PROT_READ : PROT_READ | PROT_WRITE;
+        kind = "hugetlbfs";
+        int fd = ::open(huge_path(name).c_str(), flags);
+        if (fd < 0) {
+            kind = "shared memory";
+            fd = shm_open(shm_name(name).c_str(), flags, 0);
+        }
+        struct stat info;
+        if (fd >= 0 && fstat(fd, &info) != 0) {
+            close(fd);
+            return false;
+        }
+        return fd >= 0 && map(fd, info.st_size, protection);
+    }
+
+public:
+    FrameBuffer(boost::interprocess::create_only_t, const char *name, size_t bytes, int node = -1, FramePages pages = PAGES_AUTO) :
+            address(nullptr), size(0) {
+        create(name, bytes, node, pages);
+    }
+
+    FrameBuffer(boost::interprocess::open_only_t, const char *name, boost::interprocess::mode_t mode) :
+            address(nullptr), size(0) {
+        if (!open(name, mode))
+            throw boost::interprocess::interprocess_exception("FrameBuffer: could not open frame buffer");
+    }
+
+    //opens the buffer for writing when it exists (a writer restarted while the readers kept it mapped), creates it otherwise
+    FrameBuffer(boost::interprocess::open_or_create_t, const char *name, size_t bytes, int node = -1, FramePages pages = PAGES_AUTO) :
+            address(nullptr), size(0) {
+        if (!open(name, boost::interprocess::read_write))
+            create(name, bytes, node, pages);
+    }
+
+    ~FrameBuffer() {
+        if (address)
+            munmap(address, size);
+    }
+
+    FrameBuffer(const FrameBuffer &) = delete;
+    FrameBuffer & operator=(const FrameBuffer &) = delete;
+
+    void *get_address() const { return address; }
+    size_t get_size() const { return size; }
+    const std::string & page_kind() const { return kind; }
+
+    //prefer the NUMA node for the pages of the buffer and migrate the ones already allocated elsewhere
+    bool place(int node) {
+        if (node < 0)
+            return false;
+        //the nodemask has as many words as the node needs; the kernel reads one bit less than maxnode, as in libnuma
+        const int bits = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask(node / bits + 1, 0);
+        mask[node / bits] = 1UL << (node % bits);
+        unsigned long maxnode = mask.size() * bits + 1;
+        //pages mapped by other processes too can only be moved with CAP_SYS_NICE
+        if (syscall(SYS_mbind, address, size, MPOL_PREFERRED, mask.data(), maxnode, MPOL_MF_MOVE_ALL) == 0)
+            return true;
+        return syscall(SYS_mbind, address, size, MPOL_PREFERRED, mask.data(), maxnode, MPOL_MF_MOVE) == 0;
+    }
+
+    static bool remove(const char *name) {
+        bool huge = unlink(huge_path(name).c_str()) == 0;
+        bool shm = shm_unlink(shm_name(name).c_str()) == 0;
+        return huge || shm;
+    }
+};
+
+#endif // !FRAME_BUFFER_HPP
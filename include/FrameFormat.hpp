@@ -0,0 +1,92 @@
+#ifndef FRAME_FORMAT_HPP
+#define FRAME_FORMAT_HPP
+
+#include <opencv2/core.hpp>
+
+#include "PixelFormat.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+// Format of the frame in a frame buffer. A writes it in front of every frame and increments the version whenever the
+// size, type or pixel format of the published frames changes (capture resolution requested from D, a source
+// delivering other frames), so the frame buffer is the only place B and C learn the format from. Readers keep the
+// version of the last frame they read and rebuild their views of the buffer when it differs.
+struct FrameFormat {
+    uint32_t version;
+    int32_t rows;           // size of the image
+    int32_t cols;
+    int32_t type;           // type of the Mat holding the pixels
+    int32_t pixelFormat;    // PIXEL_BGR or the native format of a camera, see PixelFormat.hpp
+
+    //format of a frame held by the given Mat
+    static FrameFormat of(const cv::Mat &frame, int32_t pixelFormat, uint32_t version) {
+        return FrameFormat{version, pixel_image_rows(pixelFormat, frame.rows), frame.cols, frame.type(), pixelFormat};
+    }
+
+    size_t bytes() const { return pixel_bytes(pixelFormat, rows, cols, type); }
+
+    cv::Size size() const { return cv::Size(cols, rows); }
+
+    bool same_as(const cv::Mat &frame, int32_t framePixelFormat) const {
+        return pixelFormat == framePixelFormat && pixel_mat_rows(pixelFormat, rows) == frame.rows && cols == frame.cols
+               && type == frame.type();
+    }
+
+    //Mat over the pixels of a frame of this format
+    cv::Mat view(void *pixels) const {
+        return cv::Mat(pixel_mat_rows(pixelFormat, rows), cols, type, pixels);
+    }
+};
+
+// A tracks which parts of the frame changed in tiles of FRAME_TILE_SIZE x FRAME_TILE_SIZE elements of the Mat
+// holding the frame, frames that would need more than FRAME_MAX_TILES get bigger tiles (see FramePublisher.hpp)
+#define FRAME_TILE_SIZE 64
+#define FRAME_MAX_TILES 8192
+
+// header of a frame slot, the pixels follow right after it
+struct FrameSlotHeader {
+    FrameFormat format;
+    int64_t captureTime;    // ms since epoch, set by A when the frame was captured
+    uint64_t sequence;      // number of the frame, incremented by A with every published frame
+    int32_t tileSize;       // grid of tiles over the Mat holding the frame
+    int32_t tilesX;
+    int32_t tilesY;
+    int32_t dirtyTiles;     // tiles that changed in this frame, all of them unless A publishes deltas
+    uint64_t dirty[FRAME_MAX_TILES / 64];       // bitmap of the tiles that changed in this frame
+    uint64_t tileSequence[FRAME_MAX_TILES];     // sequence of the frame each tile last changed in
+};
+
+// number of tiles that changed after the frame with the given sequence, the caller holds the mutex of the slot
+inline int tiles_changed_since(const FrameSlotHeader *header, uint64_t sequence) {
+    int changed = 0;
+    for (int t = 0; t < header->tilesX * header->tilesY; ++t)
+        changed += header->tileSequence[t] > sequence;
+    return changed;
+}
+
+// faces written by B start with the size of the frame they were found in, C scales them when its frame has another
+// format (the resolution changed between detection and censure), and the sequence of the frame they belong to
+struct FacesHeader {
+    int32_t cols;
+    int32_t rows;
+    uint64_t sequence;      // frame the faces belong to, named by the ticket B queues to C
+};
+
+// face found in a frame of another size scaled to a frame of the given size, rounded outwards so scaling doesn't leave
+// any pixel of the face uncensored, and clipped to the frame
+inline cv::Rect scaled_face(const cv::Rect &face, double scaleX, double scaleY, const cv::Size &frame) {
+    cv::Point topLeft(cvFloor(face.x * scaleX), cvFloor(face.y * scaleY));
+    cv::Point bottomRight(cvCeil(face.br().x * scaleX), cvCeil(face.br().y * scaleY));
+    return cv::Rect(topLeft, bottomRight) & cv::Rect(cv::Point(0, 0), frame);
+}
+
+inline FrameSlotHeader * frame_header(void *slot) {
+    return static_cast<FrameSlotHeader*>(slot);
+}
+
+inline unsigned char * frame_pixels(void *slot) {
+    return static_cast<unsigned char*>(slot) + sizeof(FrameSlotHeader);
+}
+
+#endif // !FRAME_FORMAT_HPP
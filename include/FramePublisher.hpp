@@ -0,0 +1,151 @@
+#ifndef FRAME_PUBLISHER_HPP
+#define FRAME_PUBLISHER_HPP
+
+#include "FrameFormat.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#define FRAME_TILE_WORDS (FRAME_MAX_TILES / 64)
+
+// tiles over a Mat: rows x cols tiles of size x size elements, the last row and column may be smaller
+struct TileGrid {
+    int size;
+    int cols;
+    int rows;
+
+    TileGrid() : size(FRAME_TILE_SIZE), cols(0), rows(0) {}
+
+    TileGrid(int matRows, int matCols) : size(FRAME_TILE_SIZE) {
+        while (((matCols + size - 1) / size) * ((matRows + size - 1) / size) > FRAME_MAX_TILES)
+            size *= 2;
+        cols = (matCols + size - 1) / size;
+        rows = (matRows + size - 1) / size;
+    }
+
+    int count() const { return cols * rows; }
+};
+
+inline bool tile_dirty(const uint64_t *dirty, int tile) {
+    return (dirty[tile / 64] >> (tile % 64)) & 1;
+}
+
+inline void mark_tile(uint64_t *dirty, int tile) {
+    dirty[tile / 64] |= (uint64_t)1 << (tile % 64);
+}
+
+// Marks the tiles in which current differs from previous (Mats of the same size and type) and returns their number.
+// Rows are compared in memory order, a segment of a tile already found dirty is skipped; memcmp compares every
+// segment with the widest vector instructions of the CPU.
+inline int compare_tiles(const cv::Mat &current, const cv::Mat &previous, const TileGrid &grid, uint64_t *dirty) {
+    std::fill(dirty, dirty + FRAME_TILE_WORDS, 0);
+    int changed = 0;
+    size_t elem = current.elemSize();
+    for (int r = 0; r < current.rows; ++r) {
+        int first = (r / grid.size) * grid.cols;
+        const unsigned char *a = current.ptr<unsigned char>(r);
+        const unsigned char *b = previous.ptr<unsigned char>(r);
+        for (int tx = 0; tx < grid.cols; ++tx) {
+            if (tile_dirty(dirty, first + tx))
+                continue;
+            size_t begin = (size_t)tx * grid.size * elem;
+            size_t end = (size_t)std::min((tx + 1) * grid.size, current.cols) * elem;
+            if (memcmp(a + begin, b + begin, end - begin) != 0) {
+                mark_tile(dirty, first + tx);
+                ++changed;
+            }
+        }
+    }
+    return changed;
+}
+
+// copies the dirty tiles from one Mat to another of the same size and type, neighbouring dirty tiles of a row are
+// copied at once; returns the number of bytes copied
+inline size_t copy_tiles(const cv::Mat &from, cv::Mat &to, const TileGrid &grid, const uint64_t *dirty) {
+    size_t copied = 0;
+    size_t elem = from.elemSize();
+    for (int r = 0; r < from.rows; ++r) {
+        int first = (r / grid.size) * grid.cols;
+        const unsigned char *src = from.ptr<unsigned char>(r);
+        unsigned char *dst = to.ptr<unsigned char>(r);
+        for (int tx = 0; tx < grid.cols;) {
+            if (!tile_dirty(dirty, first + tx)) {
+                ++tx;
+                continue;
+            }
+            int run = tx;
+            while (tx < grid.cols && tile_dirty(dirty, first + tx))
+                ++tx;
+            size_t begin = (size_t)run * grid.size * elem;
+            size_t end = (size_t)std::min(tx * grid.size, from.cols) * elem;
+            memcpy(dst + begin, src + begin, end - begin);
+            copied += end - begin;
+        }
+    }
+    return copied;
+}
+
+// Writes frames into a frame slot. In delta mode the frame is compared with the one in the slot and only the tiles
+// that changed are written, the slot still always holds the complete frame. Every frame gets the next sequence
+// number, the bitmap of its changed tiles and the sequence of the last change of every tile, so readers that skipped
+// frames still learn what changed since the frame they saw last.
+// prepare() compares without the mutex of the slot, which is safe since A is the only writer of the slot,
+// publish() writes with the mutex held, so the lock is held only for the copy.
+class FramePublisher {
+private:
+    bool delta;
+    TileGrid grid;
+    uint64_t dirty[FRAME_TILE_WORDS];
+    int changed;
+
+public:
+    explicit FramePublisher(bool deltaMode) : delta(deltaMode), changed(0) {
+        std::fill(dirty, dirty + FRAME_TILE_WORDS, 0);
+    }
+
+    //finds the tiles to write, frames of a new format are written whole
+    void prepare(const cv::Mat &frame, const FrameFormat &format, void *slot) {
+        const FrameSlotHeader *header = frame_header(slot);
+        grid = TileGrid(frame.rows, frame.cols);
+        if (delta && header->sequence > 0 && header->format.version == format.version && format.same_as(frame, format.pixelFormat)) {
+            changed = compare_tiles(frame, format.view(frame_pixels(slot)), grid, dirty);
+            return;
+        }
+        std::fill(dirty, dirty + FRAME_TILE_WORDS, 0);
+        for (int t = 0; t < grid.count(); ++t)
+            mark_tile(dirty, t);
+        changed = grid.count();
+    }
+
+    //writes the frame found by prepare() with its header, the caller holds the mutex of the slot;
+    //returns the number of bytes of pixels written
+    size_t publish(const cv::Mat &frame, const FrameFormat &format, int64_t captureTime, void *slot) {
+        FrameSlotHeader *header = frame_header(slot);
+        header->format = format;
+        header->captureTime = captureTime;
+        uint64_t sequence = ++header->sequence;
+        header->tileSize = grid.size;
+        header->tilesX = grid.cols;
+        header->tilesY = grid.rows;
+        header->dirtyTiles = changed;
+        memcpy(header->dirty, dirty, sizeof(dirty));
+        for (int t = 0; t < grid.count(); ++t)
+            if (tile_dirty(dirty, t))
+                header->tileSequence[t] = sequence;
+
+        if (changed == grid.count() && frame.isContinuous()) {
+            memcpy(frame_pixels(slot), frame.data, format.bytes());
+            return format.bytes();
+        }
+        cv::Mat pixels = format.view(frame_pixels(slot));
+        return copy_tiles(frame, pixels, grid, dirty);
+    }
+
+    int changed_tiles() const { return changed; }
+    int tiles() const { return grid.count(); }
+};
+
+#endif // !FRAME_PUBLISHER_HPP
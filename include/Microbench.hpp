@@ -0,0 +1,191 @@
+#ifndef MICROBENCH_HPP
+#define MICROBENCH_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// Minimal microbenchmark runner following Google Benchmark: cases are registered under a name, the number of
+// iterations grows until the case runs for at least the minimal time, and results are printed as a table or written
+// as JSON in the Google Benchmark format, so its tools (and perf_test/bench_compare.py) can diff two runs.
+// Options: --benchmark_filter=<regex> --benchmark_min_time=<seconds> --benchmark_out=<file.json>
+//          --benchmark_format=<console|json>
+
+// passed to every case, the measured loop is: while (state.keep_running()) { ... }
+class BenchState {
+private:
+    long iterations;
+    long done;
+    std::chrono::steady_clock::time_point start;
+    std::clock_t cpu_start;
+    double real_s;
+    double cpu_s;
+
+public:
+    std::map<std::string, double> counters;
+    int64_t bytes_processed;
+    int64_t items_processed;
+
+    explicit BenchState(long n) : iterations(n), done(0), real_s(0.0), cpu_s(0.0),
+                                  bytes_processed(0), items_processed(0) {}
+
+    bool keep_running() {
+        if (done == 0) {
+            start = std::chrono::steady_clock::now();
+            cpu_start = std::clock();
+        }
+        if (done++ < iterations)
+            return true;
+        real_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        cpu_s += (double)(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+        return false;
+    }
+
+    long iteration_count() const { return iterations; }
+    double real_seconds() const { return real_s; }
+    double cpu_seconds() const { return cpu_s; }
+};
+
+class Microbench {
+private:
+    struct Case {
+        std::string name;
+        std::function<void(BenchState &)> function;
+    };
+
+    struct Result {
+        std::string name;
+        long iterations;
+        double real_ns;
+        double cpu_ns;
+        std::map<std::string, double> counters;
+    };
+
+    std::vector<Case> cases;
+
+    static std::string json_escape(const std::string &text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    static Result run_case(const Case &c, double min_time) {
+        //grow the iteration count until the case takes long enough, like Google Benchmark
+        long n = 1;
+        while (true) {
+            BenchState state(n);
+            c.function(state);
+            if (state.real_seconds() >= min_time || n >= 1000000000L) {
+                Result result{c.name, n, state.real_seconds() * 1e9 / n, state.cpu_seconds() * 1e9 / n, state.counters};
+                if (state.bytes_processed > 0)
+                    result.counters["bytes_per_second"] = state.bytes_processed / state.real_seconds();
+                if (state.items_processed > 0)
+                    result.counters["items_per_second"] = state.items_processed / state.real_seconds();
+                return result;
+            }
+            double multiplier = state.real_seconds() > 0 ? 1.4 * min_time / state.real_seconds() : 10.0;
+            n = std::max(n + 1, (long)(n * std::min(10.0, std::max(multiplier, 1.0))));
+        }
+    }
+
+    static void write_json(std::ostream &out, const std::vector<Result> &results) {
+        char host[256] = "";
+        gethostname(host, sizeof(host) - 1);
+        std::time_t now = std::time(nullptr);
+        char date[64];
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+        out << "{\n  \"context\": {\n"
+            << "    \"date\": \"" << date << "\",\n"
+            << "    \"host_name\": \"" << json_escape(host) << "\",\n"
+            << "    \"num_cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+            << "    \"library_build_type\": \"release\"\n  },\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result &r = results[i];
+            out << "    {\n      \"name\": \"" << json_escape(r.name) << "\",\n"
+                << "      \"run_name\": \"" << json_escape(r.name) << "\",\n"
+                << "      \"run_type\": \"iteration\",\n"
+                << "      \"iterations\": " << r.iterations << ",\n"
+                << std::setprecision(10)
+                << "      \"real_time\": " << r.real_ns << ",\n"
+                << "      \"cpu_time\": " << r.cpu_ns << ",\n"
+                << "      \"time_unit\": \"ns\"";
+            for (const auto &counter : r.counters)
+                out << ",\n      \"" << json_escape(counter.first) << "\": " << counter.second;
+            out << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+    }
+
+public:
+    void add(const std::string &name, std::function<void(BenchState &)> function) {
+        cases.push_back(Case{name, function});
+    }
+
+    //runs the cases selected by the command line, returns the exit code of the benchmark
+    int run(int argc, char **argv) {
+        std::string filter = ".*", out_file, format = "console";
+        double min_time = 0.5;
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            std::string value = arg.substr(arg.find('=') + 1);
+            if (arg.find("--benchmark_filter=") == 0)
+                filter = value;
+            else if (arg.find("--benchmark_min_time=") == 0)
+                min_time = std::stod(value);
+            else if (arg.find("--benchmark_out=") == 0)
+                out_file = value;
+            else if (arg.find("--benchmark_format=") == 0)
+                format = value;
+            else {
+                std::cerr << "Error: unknown option " << arg << std::endl;
+                return 1;
+            }
+        }
+
+        std::regex selected(filter);
+        std::vector<Result> results;
+        if (format == "console")
+            std::cout << std::left << std::setw(60) << "Benchmark" << std::right << std::setw(16) << "Time"
+                      << std::setw(16) << "CPU" << std::setw(12) << "Iterations" << std::endl;
+        for (const auto &c : cases) {
+            if (!std::regex_search(c.name, selected))
+                continue;
+            Result r = run_case(c, min_time);
+            results.push_back(r);
+            if (format == "console") {
+                std::cout << std::left << std::setw(60) << r.name << std::right << std::fixed << std::setprecision(0)
+                          << std::setw(13) << r.real_ns << " ns" << std::setw(13) << r.cpu_ns << " ns" << std::setw(12) << r.iterations;
+                for (const auto &counter : r.counters)
+                    std::cout << " " << counter.first << "=" << std::setprecision(3) << std::scientific << counter.second << std::fixed;
+                std::cout << std::endl;
+            }
+        }
+
+        if (format == "json")
+            write_json(std::cout, results);
+        if (!out_file.empty()) {
+            std::ofstream file(out_file);
+            write_json(file, results);
+        }
+        return 0;
+    }
+};
+
+#endif // !MICROBENCH_HPP
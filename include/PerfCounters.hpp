@@ -0,0 +1,114 @@
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include "stats.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Hardware and software performance counters of a whole process, read with perf_event_open.
+// The counters are opened at the start of main with inherit set, so every thread created later (capture and censure
+// threads, the OpenCV thread pool) is counted as well. The counts are turned into averages per frame of the stage
+// and written to the ProcessStats of the process, which D displays.
+// When the kernel doesn't permit counting (perf_event_paranoid, containers without PMU access) the missing counters
+// stay at 0 and the state tells D why.
+class PerfCounters {
+private:
+    struct Counter {
+        int fd;
+        uint64_t last;
+    };
+
+    Counter counters[PERF_COUNTERS];
+    int64_t last_frames;
+    std::chrono::steady_clock::time_point last_sample;
+    int state;
+
+    static int open_counter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0) {
+            //unprivileged users may still count their own user space
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+        return fd;
+    }
+
+    //value scaled up for the time the counter wasn't scheduled on the PMU (multiplexing)
+    static uint64_t read_counter(int fd) {
+        uint64_t values[3] = {0, 0, 0};
+        if (fd < 0 || read(fd, values, sizeof(values)) != sizeof(values) || values[2] == 0)
+            return 0;
+        return (uint64_t)((double)values[0] * values[1] / values[2]);
+    }
+
+public:
+    //counting is opt-in, a disabled instance only reports PERF_OFF
+    explicit PerfCounters(bool enabled) : last_frames(0), last_sample(std::chrono::steady_clock::now()), state(PERF_OFF) {
+        static const uint32_t types[PERF_COUNTERS] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                                      PERF_TYPE_HARDWARE, PERF_TYPE_SOFTWARE};
+        static const uint64_t configs[PERF_COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES,
+                                                        PERF_COUNT_SW_CONTEXT_SWITCHES};
+        int opened = 0;
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            counters[i].fd = enabled ? open_counter(types[i], configs[i]) : -1;
+            counters[i].last = 0;
+            if (counters[i].fd >= 0)
+                ++opened;
+        }
+        if (enabled) {
+            state = opened == PERF_COUNTERS ? PERF_ON : opened > 0 ? PERF_PARTIAL : PERF_DENIED;
+            if (state != PERF_ON)
+                std::cerr << "Warning: only " << opened << " of " << PERF_COUNTERS << " performance counters could be opened, "
+                          << "check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+        }
+    }
+
+    ~PerfCounters() {
+        for (int i = 0; i < PERF_COUNTERS; ++i)
+            if (counters[i].fd >= 0)
+                close(counters[i].fd);
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters & operator=(const PerfCounters &) = delete;
+
+    //update the averages per frame, frames is the number of frames (or batches) handled so far.
+    //Sampled at most every RATE_CONTROL_PERIOD_MS, the caller holds the stats mutex.
+    void sample(PerfStats &perf, int64_t frames) {
+        perf.state = state;
+        if (state == PERF_OFF || state == PERF_DENIED)
+            return;
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_sample < std::chrono::milliseconds(RATE_CONTROL_PERIOD_MS) || frames <= last_frames)
+            return;
+
+        for (int i = 0; i < PERF_COUNTERS; ++i) {
+            uint64_t value = read_counter(counters[i].fd);
+            //the first sample also covers the startup, it only initializes the counters
+            if (last_frames > 0)
+                updateAverage(perf.perFrame[i], (double)(value - counters[i].last) / (frames - last_frames));
+            counters[i].last = value;
+        }
+        last_frames = frames;
+        last_sample = now;
+    }
+};
+
+#endif // !PERF_COUNTERS_HPP
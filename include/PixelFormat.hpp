@@ -0,0 +1,162 @@
+#ifndef PIXEL_FORMAT_HPP
+#define PIXEL_FORMAT_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Layout of the pixels A publishes. By default VideoCapture converts everything it captures to BGR (3 bytes per
+// pixel), cameras can deliver their native YUV formats instead. Those are published as they come and converted to BGR
+// only where BGR is needed: B converts the frame after scaling it down to the detector input, C converts the frame
+// once when it takes it out of the frame buffer for display.
+#define PIXEL_BGR 0     // whatever VideoCapture delivers with conversion, described by the Mat type alone
+#define PIXEL_YUYV 1    // packed 4:2:2, Y0 U Y1 V for every two pixels, a rows x cols CV_8UC2 Mat
+#define PIXEL_NV12 2    // planar 4:2:0, Y plane followed by interleaved UV at half resolution, a rows*3/2 x cols CV_8UC1 Mat
+
+inline const char * pixel_format_name(int format) {
+    switch (format) {
+        case PIXEL_YUYV: return "YUYV";
+        case PIXEL_NV12: return "NV12";
+        default: return "BGR";
+    }
+}
+
+inline uint32_t pixel_fourcc(int format) {
+    const char *code = format == PIXEL_YUYV ? "YUYV" : format == PIXEL_NV12 ? "NV12" : "BGR3";
+    return (uint32_t)code[0] | (uint32_t)code[1] << 8 | (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24;
+}
+
+// formats of the given name (yuyv, nv12 or auto for both in this order of preference), empty for an unknown name
+inline std::vector<int> native_formats(const std::string &name) {
+    if (name == "yuyv")
+        return {PIXEL_YUYV};
+    if (name == "nv12")
+        return {PIXEL_NV12};
+    if (name == "auto")
+        return {PIXEL_YUYV, PIXEL_NV12};
+    return {};
+}
+
+// rows of the Mat holding an image with the given rows
+inline int pixel_mat_rows(int format, int rows) {
+    return format == PIXEL_NV12 ? rows * 3 / 2 : rows;
+}
+
+// rows of the image held by a Mat with the given rows
+inline int pixel_image_rows(int format, int mat_rows) {
+    return format == PIXEL_NV12 ? mat_rows * 2 / 3 : mat_rows;
+}
+
+// type of the Mat holding a native image, BGR images keep the type VideoCapture gave them
+inline int pixel_mat_type(int format, int bgr_type) {
+    return format == PIXEL_YUYV ? CV_8UC2 : format == PIXEL_NV12 ? CV_8UC1 : bgr_type;
+}
+
+inline size_t pixel_bytes(int format, int rows, int cols, int type) {
+    return (size_t)pixel_mat_rows(format, rows) * cols * CV_ELEM_SIZE(type);
+}
+
+// Mat over a raw native frame of the given image size (VideoCapture without conversion may deliver it as a single row
+// of bytes), shares the data; empty when the frame doesn't hold an image of that size
+inline cv::Mat native_view(const cv::Mat &raw, int format, cv::Size size) {
+    int type = pixel_mat_type(format, CV_8UC3);
+    if (raw.empty() || !raw.isContinuous() || size.width % 2 != 0 || size.height % 2 != 0
+        || raw.total() * raw.elemSize() != pixel_bytes(format, size.height, size.width, type))
+        return cv::Mat();
+    return raw.reshape(CV_MAT_CN(type), pixel_mat_rows(format, size.height));
+}
+
+// Scales a frame without leaving its pixel format, the native formats keep their chroma subsampling (so the size is
+// rounded down to even numbers). YUYV is scaled as a Mat of Y0 U Y1 V macropixels, NV12 plane by plane.
+inline void resize_native(const cv::Mat &frame, int format, cv::Size size, cv::Mat &scaled, int interpolation) {
+    if (format == PIXEL_BGR) {
+        cv::resize(frame, scaled, size, 0, 0, interpolation);
+        return;
+    }
+    size = cv::Size(std::max(2, size.width & ~1), std::max(2, size.height & ~1));
+    if (format == PIXEL_YUYV) {
+        cv::Mat macropixels;
+        cv::resize(frame.reshape(4), macropixels, cv::Size(size.width / 2, size.height), 0, 0, interpolation);
+        scaled = macropixels.reshape(2);
+        return;
+    }
+    //the source keeps its pixels when the frame is scaled in place
+    cv::Mat source = frame;
+    int rows = pixel_image_rows(format, source.rows);
+    scaled.create(size.height * 3 / 2, size.width, CV_8UC1);
+    cv::Mat y = scaled.rowRange(0, size.height);
+    cv::Mat uv = scaled.rowRange(size.height, scaled.rows).reshape(2, size.height / 2);
+    cv::resize(source.rowRange(0, rows), y, size, 0, 0, interpolation);
+    cv::resize(source.rowRange(rows, source.rows).reshape(2, rows / 2), uv, cv::Size(size.width / 2, size.height / 2), 0, 0, interpolation);
+}
+
+// BGR image of a frame, a copy for BGR frames
+inline void to_bgr(const cv::Mat &frame, int format, cv::Mat &bgr) {
+    if (format == PIXEL_YUYV)
+        cv::cvtColor(frame, bgr, cv::COLOR_YUV2BGR_YUYV);
+    else if (format == PIXEL_NV12)
+        cv::cvtColor(frame, bgr, cv::COLOR_YUV2BGR_NV12);
+    else
+        frame.copyTo(bgr);
+}
+
+// BGR image of the frame scaled to the given size; native frames are scaled first, so only the pixels of the scaled
+// image are converted
+inline void scaled_bgr(const cv::Mat &frame, int format, cv::Size size, cv::Mat &bgr) {
+    if (format == PIXEL_BGR) {
+        cv::resize(frame, bgr, size);
+        return;
+    }
+    cv::Mat scaled;
+    resize_native(frame, format, size, scaled, cv::INTER_LINEAR);
+    to_bgr(scaled, format, bgr);
+    if (bgr.size() != size)
+        cv::resize(bgr, bgr, size);
+}
+
+// native frame of a BGR image with even width and height, the same BT.601 conversion cameras use (synthetic source,
+// benchmarks)
+inline void bgr_to_native(const cv::Mat &bgr, int format, cv::Mat &native) {
+    if (format == PIXEL_BGR) {
+        bgr.copyTo(native);
+        return;
+    }
+    int rows = bgr.rows, cols = bgr.cols;
+    cv::Mat i420;
+    cv::cvtColor(bgr, i420, cv::COLOR_BGR2YUV_I420);
+    const unsigned char *y = i420.data;
+    const unsigned char *u = y + rows * cols;
+    const unsigned char *v = u + rows * cols / 4;
+
+    if (format == PIXEL_NV12) {
+        native.create(rows * 3 / 2, cols, CV_8UC1);
+        memcpy(native.data, y, (size_t)rows * cols);
+        unsigned char *uv = native.data + rows * cols;
+        for (int i = 0; i < rows * cols / 4; ++i) {
+            uv[2 * i] = u[i];
+            uv[2 * i + 1] = v[i];
+        }
+        return;
+    }
+    native.create(rows, cols, CV_8UC2);
+    for (int r = 0; r < rows; ++r) {
+        unsigned char *out = native.ptr<unsigned char>(r);
+        const unsigned char *yRow = y + r * cols;
+        const unsigned char *uRow = u + (r / 2) * (cols / 2);
+        const unsigned char *vRow = v + (r / 2) * (cols / 2);
+        for (int x = 0; x < cols; x += 2) {
+            out[2 * x] = yRow[x];
+            out[2 * x + 1] = uRow[x / 2];
+            out[2 * x + 2] = yRow[x + 1];
+            out[2 * x + 3] = vRow[x / 2];
+        }
+    }
+}
+
+#endif // !PIXEL_FORMAT_HPP
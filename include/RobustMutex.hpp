@@ -0,0 +1,139 @@
+#ifndef ROBUST_MUTEX_HPP
+#define ROBUST_MUTEX_HPP
+
+#include <boost/interprocess/creation_tags.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <pthread.h>
+#include <unistd.h>
+
+// Drop-in replacement of boost::interprocess::named_mutex for the locks shared by A, B and C.
+// The pthread mutex lives in its own shared memory object and is
+//  - process shared,
+//  - priority inheriting: a SCHED_OTHER process holding the lock (e.g. A copying a frame) runs at the priority of
+//    the real-time process waiting for it, so the waiter can't be delayed indefinitely by medium priority work,
+//  - robust: when the owner dies holding the lock, the next locker gets EOWNERDEAD, marks the mutex consistent and
+//    continues. The guarded data may be half written, which for frames and face lists only means one bad frame.
+
+// how long opening waits for the creator to size and initialize the mutex, a creator that died in between would
+// otherwise leave the opener waiting forever
+#define ROBUST_MUTEX_OPEN_TIMEOUT_MS 5000
+class RobustMutex {
+private:
+    struct Storage {
+        pthread_mutex_t mutex;
+        std::atomic<int> initialized;
+    };
+
+    boost::interprocess::shared_memory_object shmem;
+    boost::interprocess::mapped_region region;
+    Storage *storage;
+
+    static void check(int result, const char *what) {
+        if (result != 0)
+            throw boost::interprocess::interprocess_exception(what);
+    }
+
+    void create(const char *name) {
+        boost::interprocess::shared_memory_object object(boost::interprocess::create_only, name, boost::interprocess::read_write);
+        object.truncate(sizeof(Storage));
+        boost::interprocess::mapped_region mapped(object, boost::interprocess::read_write);
+        shmem.swap(object);
+        region.swap(mapped);
+        storage = static_cast<Storage*>(region.get_address());
+
+        pthread_mutexattr_t attr;
+        check(pthread_mutexattr_init(&attr), "RobustMutex: pthread_mutexattr_init failed");
+        check(pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED), "RobustMutex: process shared mutexes are not supported");
+        check(pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT), "RobustMutex: priority inheritance is not supported");
+        check(pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST), "RobustMutex: robust mutexes are not supported");
+        check(pthread_mutex_init(&storage->mutex, &attr), "RobustMutex: pthread_mutex_init failed");
+        pthread_mutexattr_destroy(&attr);
+        storage->initialized.store(1, std::memory_order_release);
+    }
+
+    void open(const char *name) {
+        boost::interprocess::shared_memory_object object(boost::interprocess::open_only, name, boost::interprocess::read_write);
+        //the creator may not have sized and initialized the object yet
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(ROBUST_MUTEX_OPEN_TIMEOUT_MS);
+        boost::interprocess::offset_t size = 0;
+        while (!object.get_size(size) || size < (boost::interprocess::offset_t)sizeof(Storage)) {
+            if (std::chrono::steady_clock::now() > deadline)
+                throw boost::interprocess::interprocess_exception("RobustMutex: the creator of the mutex never sized it");
+            usleep(1000);
+        }
+        boost::interprocess::mapped_region mapped(object, boost::interprocess::read_write);
+        shmem.swap(object);
+        region.swap(mapped);
+        storage = static_cast<Storage*>(region.get_address());
+        while (storage->initialized.load(std::memory_order_acquire) != 1) {
+            if (std::chrono::steady_clock::now() > deadline)
+                throw boost::interprocess::interprocess_exception("RobustMutex: the creator of the mutex never initialized it");
+            usleep(1000);
+        }
+    }
+
+public:
+    RobustMutex(boost::interprocess::create_only_t, const char *name) : storage(nullptr) {
+        create(name);
+    }
+
+    RobustMutex(boost::interprocess::open_only_t, const char *name) : storage(nullptr) {
+        open(name);
+    }
+
+    RobustMutex(boost::interprocess::open_or_create_t, const char *name) : storage(nullptr) {
+        try {
+            create(name);
+        } catch (const boost::interprocess::interprocess_exception &e) {
+            if (e.get_error_code() != boost::interprocess::already_exists_error)
+                throw;
+            open(name);
+        }
+    }
+
+    RobustMutex(const RobustMutex &) = delete;
+    RobustMutex & operator=(const RobustMutex &) = delete;
+
+    void lock() {
+        recover(pthread_mutex_lock(&storage->mutex));
+    }
+
+    bool try_lock() {
+        int result = pthread_mutex_trylock(&storage->mutex);
+        if (result == EBUSY)
+            return false;
+        recover(result);
+        return true;
+    }
+
+    void unlock() {
+        check(pthread_mutex_unlock(&storage->mutex), "RobustMutex: unlock failed");
+    }
+
+    //removes the shared memory object of the mutex, processes which have it mapped can still use it
+    static bool remove(const char *name) {
+        return boost::interprocess::shared_memory_object::remove(name);
+    }
+
+private:
+    //result of a successful lock, the previous owner may have died holding it
+    void recover(int result) {
+        if (result == EOWNERDEAD) {
+            std::cerr << "Warning: owner of a shared mutex died holding it, recovering" << std::endl;
+            check(pthread_mutex_consistent(&storage->mutex), "RobustMutex: could not make the mutex consistent");
+        }
+        else
+            check(result, "RobustMutex: lock failed");
+    }
+};
+
+#endif // !ROBUST_MUTEX_HPP
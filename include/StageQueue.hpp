@@ -0,0 +1,210 @@
+#ifndef STAGE_QUEUE_HPP
+#define STAGE_QUEUE_HPP
+
+#include "stats.hpp"
+
+#include <boost/interprocess/creation_tags.hpp>
+#include <boost/interprocess/ipc/message_queue.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+
+#include <unistd.h>
+
+// Bounded queues between the stages: A -> B tells B which frames to detect, B -> C tells C that the faces of a frame
+// are ready. Items are tickets naming a frame, the pixels and faces stay in the frame buffer and the faces shmem,
+// which have a single slot per stream. A waiting ticket is only worth something while its payload is still in the
+// slot, so a queue holds a single item. The producer applies the policy of its queue:
+//  - latest wins: a new item replaces the one still waiting,
+//  - block: the producer waits until the consumer took the waiting item before it writes the next payload, the
+//    backpressure reaches A, which then skips captured frames,
+//  - every Nth: only every Nth item is queued, replacing the one still waiting.
+// The consumer skips items naming a frame older than the one it processed last (superseded). The policy is set at
+// startup and from D.
+#define QUEUE_LATEST_WINS 0
+#define QUEUE_BLOCK 1
+#define QUEUE_EVERY_NTH 2
+
+// a queue holds one ticket, the payload slot holds one frame or face list
+#define QUEUE_CAPACITY 1
+// a blocked producer gives up after this long and drops the item, so it goes on while the consumer is restarted by D
+#define QUEUE_BLOCK_TIMEOUT_MS 1000
+#define QUEUE_BLOCK_POLL_US 200
+
+struct QueuePolicy {
+    int32_t policy;
+    int32_t nth;    // QUEUE_EVERY_NTH queues every nth item
+};
+
+// "latest", "block" or "every:<n>", false for anything else
+inline bool parse_queue_policy(const std::string &text, QueuePolicy &policy) {
+    QueuePolicy parsed = {QUEUE_LATEST_WINS, 1};
+    if (text.compare(0, 6, "every:") == 0) {
+        parsed.policy = QUEUE_EVERY_NTH;
+        parsed.nth = atoi(text.c_str() + 6);
+        if (parsed.nth < 1 || text.find_first_not_of("0123456789", 6) != std::string::npos)
+            return false;
+    }
+    else if (text == "block")
+        parsed.policy = QUEUE_BLOCK;
+    else if (text != "latest")
+        return false;
+    policy = parsed;
+    return true;
+}
+
+inline std::string queue_policy_name(int policy, int nth) {
+    switch (policy) {
+        case QUEUE_BLOCK: return "block";
+        case QUEUE_EVERY_NTH: return "every:" + std::to_string(nth);
+        default: return "latest";
+    }
+}
+
+// item of a queue: the frame (sequence number in the frame buffer) and when it was captured
+struct FrameTicket {
+    uint64_t sequence;
+    int64_t captureTime;
+};
+
+// A queue is used by one producer and one consumer thread, the policy can be changed from a listener thread.
+class StageQueue {
+private:
+    boost::interprocess::message_queue queue;
+    std::mutex mutex;
+    QueuePolicy policy;
+
+    //producer side
+    int64_t offered = 0;
+    int64_t pushed = 0;
+    int64_t dropped = 0;
+    int64_t samples = 0;
+    double occupancySum = 0;
+    int maxOccupancy = 0;
+    double blockedMs = 0;
+
+    //consumer side, read by the thread reporting stats
+    std::atomic<int64_t> superseded{0};
+
+    bool drop_oldest() {
+        FrameTicket ticket;
+        size_t size;
+        unsigned int priority;
+        if (!queue.try_receive(&ticket, sizeof(ticket), size, priority))
+            return false;
+        ++dropped;
+        return true;
+    }
+
+public:
+    //queue of the producer, created unless it reattaches to the queue of a running pipeline
+    StageQueue(boost::interprocess::open_or_create_t, const char *name, const QueuePolicy &initial) :
+        queue(boost::interprocess::open_or_create, name, QUEUE_CAPACITY, sizeof(FrameTicket)), policy(initial) {}
+
+    //queue of the consumer, the policy is the business of the producer
+    StageQueue(boost::interprocess::open_only_t, const char *name) :
+        queue(boost::interprocess::open_only, name), policy{QUEUE_LATEST_WINS, 1} {}
+
+    StageQueue(const StageQueue &) = delete;
+    StageQueue & operator=(const StageQueue &) = delete;
+
+    static bool remove(const char *name) {
+        return boost::interprocess::message_queue::remove(name);
+    }
+
+    void set_policy(const QueuePolicy &requested) {
+        std::lock_guard<std::mutex> lock(mutex);
+        policy = requested;
+    }
+
+    QueuePolicy get_policy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return policy;
+    }
+
+    //producer: waits until there is room for the next item when the queue blocks, called before the payload is written
+    void wait_for_room() {
+        QueuePolicy current = get_policy();
+        if (current.policy != QUEUE_BLOCK || queue.get_num_msg() < QUEUE_CAPACITY)
+            return;
+        auto start = std::chrono::steady_clock::now();
+        while (queue.get_num_msg() >= QUEUE_CAPACITY
+               && std::chrono::steady_clock::now() - start < std::chrono::milliseconds(QUEUE_BLOCK_TIMEOUT_MS))
+            usleep(QUEUE_BLOCK_POLL_US);
+        blockedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //producer: queues the item following the policy, false when it was dropped
+    bool push(const FrameTicket &ticket) {
+        QueuePolicy current = get_policy();
+        size_t waiting = queue.get_num_msg();
+        occupancySum += waiting;
+        ++samples;
+        maxOccupancy = std::max(maxOccupancy, (int)waiting);
+
+        if (current.policy == QUEUE_EVERY_NTH && offered++ % current.nth != 0) {
+            ++dropped;
+            return false;
+        }
+        if (current.policy == QUEUE_BLOCK && waiting >= QUEUE_CAPACITY) {
+            //the wait for room timed out
+            ++dropped;
+            return false;
+        }
+        while (drop_oldest());
+
+        if (!queue.try_send(&ticket, sizeof(ticket), 0)) {
+            ++dropped;
+            return false;
+        }
+        ++pushed;
+        return true;
+    }
+
+    //consumer: waits for the next item naming a frame newer than the given sequence, older ones are skipped
+    FrameTicket pop_newer(uint64_t sequence) {
+        FrameTicket ticket;
+        size_t size;
+        unsigned int priority;
+        while (true) {
+            queue.receive(&ticket, sizeof(ticket), size, priority);
+            if (ticket.sequence > sequence)
+                return ticket;
+            ++superseded;
+        }
+    }
+
+    //consumer: the next item naming a frame newer than the given sequence, false when there is none
+    bool try_pop_newer(uint64_t sequence, FrameTicket &ticket) {
+        size_t size;
+        unsigned int priority;
+        while (queue.try_receive(&ticket, sizeof(ticket), size, priority)) {
+            if (ticket.sequence > sequence)
+                return true;
+            ++superseded;
+        }
+        return false;
+    }
+
+    //producer: its counters and the policy into the stats of the queue, the caller holds the stats mutex
+    void report(QueueStats &stats) {
+        QueuePolicy current = get_policy();
+        stats.policy = current.policy;
+        stats.nth = current.nth;
+        stats.pushed = pushed;
+        stats.dropped = dropped;
+        stats.occupancy = samples > 0 ? occupancySum / samples : 0.0;
+        stats.maxOccupancy = maxOccupancy;
+        stats.blockedMs = blockedMs;
+    }
+
+    //consumer: items skipped since their frame was older than the one processed last
+    int64_t superseded_count() const { return superseded; }
+};
+
+#endif // !STAGE_QUEUE_HPP
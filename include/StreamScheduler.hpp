@@ -0,0 +1,79 @@
+#ifndef STREAM_SCHEDULER_HPP
+#define STREAM_SCHEDULER_HPP
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+#include "stats.hpp"
+
+// Fair scheduler deciding which streams get a slot in the next batched inference of process B.
+// The number of slots follows the inference budget: the cost of a single frame is estimated from the measured
+// batch times, and when frames of all streams don't fit into the budget, the streams that waited the longest
+// are served first. This way load is shed evenly across streams and none of them is starved.
+class StreamScheduler {
+private:
+    int streams;
+    double budget_ms;
+    //moving average of inference time per frame in a batch
+    double frame_cost_ms;
+
+    //round in which each stream was last served
+    std::vector<long> last_served;
+    long round;
+
+    std::vector<long> served;
+    std::vector<long> shed;
+
+public:
+    StreamScheduler(int n_of_streams, double inference_budget_ms) :
+            streams(n_of_streams),
+            budget_ms(inference_budget_ms),
+            frame_cost_ms(0.0),
+            last_served(n_of_streams, -1),
+            round(0),
+            served(n_of_streams, 0),
+            shed(n_of_streams, 0) {}
+
+    //number of frames that fit into the budget, at least one so no stream stalls forever
+    int slots() const {
+        if (frame_cost_ms <= 0.0)
+            return streams;
+        return std::max(1, std::min(streams, (int)(budget_ms / frame_cost_ms)));
+    }
+
+    //streams whose latest frame goes into the next batch, in ascending order
+    std::vector<int> next_batch() {
+        std::vector<int> order(streams);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return last_served[a] < last_served[b]; });
+
+        int n = slots();
+        std::vector<int> batch(order.begin(), order.begin() + n);
+        for (int s : batch) {
+            last_served[s] = round;
+            served[s]++;
+        }
+        for (int i = n; i < streams; ++i)
+            shed[order[i]]++;
+        round++;
+
+        std::sort(batch.begin(), batch.end());
+        return batch;
+    }
+
+    //report the time of the batched forward pass for the last batch
+    void batch_done(size_t batch_size, double batch_ms) {
+        updateAverage(frame_cost_ms, batch_ms / batch_size);
+    }
+
+    //time a batch with frames of all streams would take
+    double full_round_ms() const {
+        return frame_cost_ms * streams;
+    }
+
+    long served_count(int stream) const { return served[stream]; }
+    long shed_count(int stream) const { return shed[stream]; }
+};
+
+#endif // !STREAM_SCHEDULER_HPP
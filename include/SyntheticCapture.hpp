@@ -0,0 +1,126 @@
+#ifndef SYNTHETIC_CAPTURE_HPP
+#define SYNTHETIC_CAPTURE_HPP
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "PixelFormat.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// rate of the synthetic source, like a typical camera
+#define SYNTHETIC_FPS 30
+#define SYNTHETIC_WIDTH 640
+#define SYNTHETIC_HEIGHT 480
+
+// Camera replacement used for soak runs and machines without a camera: frames of noise with a bright ellipse in place
+// of a face which moves around the frame, delivered at SYNTHETIC_FPS like a real camera would. The source
+// "synthetic" gives SYNTHETIC_WIDTH x SYNTHETIC_HEIGHT frames, "synthetic:WxH" any other size.
+// It derives from cv::VideoCapture, so the capture loop of A uses it like any other source. Like a camera it delivers
+// YUYV or NV12 frames when asked for the FOURCC with conversion to RGB turned off.
+class SyntheticCapture : public cv::VideoCapture {
+private:
+    cv::Mat background;
+    int64_t frames;
+    std::chrono::steady_clock::time_point next;
+    bool opened;
+    int pixelFormat;
+    bool convertRgb;
+
+public:
+    SyntheticCapture() : frames(0), opened(false), pixelFormat(PIXEL_BGR), convertRgb(true) {}
+
+    //true for sources handled by this class
+    static bool handles(const std::string &source) {
+        return source.compare(0, 9, "synthetic") == 0;
+    }
+
+    bool open(const cv::String &source, int = cv::CAP_ANY) override {
+        int width = SYNTHETIC_WIDTH, height = SYNTHETIC_HEIGHT;
+        size_t colon = source.find(':');
+        if (colon != std::string::npos && sscanf(source.c_str() + colon + 1, "%dx%d", &width, &height) != 2)
+            return false;
+        if (width < 64 || height < 64)
+            return false;
+        //the noise is generated once, regenerating it for every frame would cost more than a camera read
+        background.create(height, width, CV_8UC3);
+        cv::randu(background, cv::Scalar::all(0), cv::Scalar::all(255));
+        frames = 0;
+        next = std::chrono::steady_clock::now();
+        opened = true;
+        return true;
+    }
+
+    bool isOpened() const override { return opened; }
+
+    void release() override { opened = false; }
+
+    bool read(cv::OutputArray image) override {
+        if (!opened)
+            return false;
+        std::this_thread::sleep_until(next);
+        next += std::chrono::microseconds(1000000 / SYNTHETIC_FPS);
+
+        cv::Mat frame = background.clone();
+        //the face circles the center of the frame once every 10 seconds
+        double angle = 2.0 * M_PI * frames / (10.0 * SYNTHETIC_FPS);
+        cv::Size face(frame.cols / 12, frame.cols / 9);
+        cv::Point center(frame.cols / 2 + (int)(frame.cols / 4 * std::cos(angle)),
+                         frame.rows / 2 + (int)(frame.rows / 4 * std::sin(angle)));
+        cv::ellipse(frame, center, face, 0, 0, 360, cv::Scalar(150, 170, 210), -1);
+        ++frames;
+        if (convertRgb || pixelFormat == PIXEL_BGR)
+            frame.copyTo(image);
+        else {
+            cv::Mat native;
+            bgr_to_native(frame, pixelFormat, native);
+            native.copyTo(image);
+        }
+        return true;
+    }
+
+    cv::VideoCapture & operator>>(cv::Mat &image) override {
+        if (!read(image))
+            image.release();
+        return *this;
+    }
+
+    //seeking (used to replay video files) restarts the motion, the native formats require even frame sizes
+    bool set(int property, double value) override {
+        if (property == cv::CAP_PROP_POS_FRAMES) {
+            frames = (int64_t)value;
+            return true;
+        }
+        if (property == cv::CAP_PROP_CONVERT_RGB) {
+            convertRgb = value != 0;
+            return true;
+        }
+        if (property == cv::CAP_PROP_FOURCC) {
+            for (int format : {PIXEL_BGR, PIXEL_YUYV, PIXEL_NV12})
+                if ((uint32_t)value == pixel_fourcc(format) && (format == PIXEL_BGR || (background.cols % 2 == 0 && background.rows % 2 == 0))) {
+                    pixelFormat = format;
+                    return true;
+                }
+        }
+        return false;
+    }
+
+    double get(int property) const override {
+        switch (property) {
+            case cv::CAP_PROP_FRAME_WIDTH: return background.cols;
+            case cv::CAP_PROP_FRAME_HEIGHT: return background.rows;
+            case cv::CAP_PROP_FPS: return SYNTHETIC_FPS;
+            case cv::CAP_PROP_POS_FRAMES: return (double)frames;
+            case cv::CAP_PROP_FOURCC: return pixel_fourcc(pixelFormat);
+            case cv::CAP_PROP_CONVERT_RGB: return convertRgb;
+            default: return 0.0;
+        }
+    }
+};
+
+#endif // !SYNTHETIC_CAPTURE_HPP
@@ -0,0 +1,152 @@
+#ifndef THREAD_BUDGET_HPP
+#define THREAD_BUDGET_HPP
+
+#include "names.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// CPU topology of a set of logical CPUs, read from /sys/devices/system/cpu
+struct CpuTopology {
+    int cpus;           // logical CPUs (hardware threads)
+    int cores;          // physical cores, SMT siblings are counted once
+};
+
+//logical CPUs the given thread (0 = calling thread) is allowed to run on
+inline std::vector<int> allowed_cpus(pid_t tid = 0) {
+    std::vector<int> cpus;
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(tid, sizeof(cpu_set_t), &mask) != 0)
+        return cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &mask))
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+//first line of a sysfs file, empty when it can't be read
+inline std::string read_sysfs(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+inline CpuTopology topology_of(const std::vector<int> &cpus) {
+    std::set<std::pair<std::string, std::string>> cores;
+    for (int cpu : cpus) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        std::string package = read_sysfs(dir + "/topology/physical_package_id");
+        std::string core = read_sysfs(dir + "/topology/core_id");
+        //without topology information every logical CPU is a core of its own
+        if (core.empty())
+            core = "cpu" + std::to_string(cpu);
+        cores.insert(std::make_pair(package, core));
+    }
+
+    CpuTopology topology;
+    topology.cpus = cpus.size();
+    topology.cores = cores.size();
+    return topology;
+}
+
+// Number of worker threads for compute heavy OpenCV code (dnn forward, blurring) running on the given CPUs.
+// One thread per physical core: SMT siblings share the execution units, so a second thread per core adds
+// context switches and cache pressure without adding throughput.
+inline int thread_budget(const CpuTopology &topology) {
+    return std::max(1, topology.cores);
+}
+
+// Keeps the OpenCV thread pool of a process matched to the CPU affinity set by process D.
+// D changes the affinity of the main thread only and then sends AFFINITY_CHANGED_SIGNAL, the process calls poll()
+// between frames, which copies the new mask to all of its threads (capture/censure threads and the OpenCV workers)
+// and resizes the thread pool to the budget of the allowed cores.
+// The default action of the signal terminates the process, so main calls ThreadBudget::catch_signal() first thing,
+// before D can know the process and send the signal.
+class ThreadBudget {
+private:
+    std::string process;
+    //thread count forced on the command line, 0 means it follows the affinity
+    int fixed;
+    int current;
+    std::mutex apply_mutex;
+
+    static volatile sig_atomic_t & changed() {
+        static volatile sig_atomic_t flag = 0;
+        return flag;
+    }
+
+    static void handle_signal(int sig) {
+        changed() = 1;
+    }
+
+    //give every thread of the process the affinity of the main thread
+    void propagate_affinity() {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        if (sched_getaffinity(getpid(), sizeof(cpu_set_t), &mask) != 0)
+            return;
+        DIR *tasks = opendir("/proc/self/task");
+        if (tasks == NULL)
+            return;
+        while (dirent *task = readdir(tasks)) {
+            pid_t tid = atoi(task->d_name);
+            if (tid > 0 && tid != getpid())
+                sched_setaffinity(tid, sizeof(cpu_set_t), &mask);
+        }
+        closedir(tasks);
+    }
+
+public:
+    ThreadBudget(const std::string &process_name, int fixed_threads = 0) :
+            process(process_name), fixed(fixed_threads), current(0) {
+        catch_signal();
+        apply();
+    }
+
+    //a signal arriving before the budget exists is remembered and applied by its first poll()
+    static void catch_signal() {
+        signal(AFFINITY_CHANGED_SIGNAL, handle_signal);
+    }
+
+    //recompute the budget from the current affinity and resize the thread pool
+    int apply() {
+        std::lock_guard<std::mutex> lock(apply_mutex);
+        propagate_affinity();
+        CpuTopology topology = topology_of(allowed_cpus(getpid()));
+        int threads = fixed > 0 ? fixed : thread_budget(topology);
+        if (threads != current) {
+            cv::setNumThreads(threads);
+            current = threads;
+            std::cout << "Process " << process << " runs on " << topology.cpus << " CPUs (" << topology.cores << " cores), OpenCV threads: " << threads << std::endl;
+        }
+        return current;
+    }
+
+    //apply the budget again if D changed the affinity since the last call
+    void poll() {
+        if (changed()) {
+            changed() = 0;
+            apply();
+        }
+    }
+
+    int threads() const { return current; }
+};
+
+#endif // !THREAD_BUDGET_HPP
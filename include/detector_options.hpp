@@ -0,0 +1,27 @@
+#ifndef DETECTOR_OPTIONS_HPP
+#define DETECTOR_OPTIONS_HPP
+
+#include "FaceDetector.hpp"
+
+#include <boost/program_options.hpp>
+
+#include <string>
+
+// options choosing the detector, used on the command line of B, for detectors requested from the UI and for the
+// configurations of the evaluation harness; options that are not given keep the values already in config and mode
+inline void add_detector_options(boost::program_options::options_description & options, DetectorConfig & config, InferenceMode & mode) {
+    namespace po = boost::program_options;
+    options.add_options()
+        ("detector", po::value<std::string>(&config.backend)->default_value(config.backend), "face detector backend: caffe, onnx, haar or lbp")
+        ("model", po::value<std::string>(&config.model), "model file: caffemodel, onnx model or cascade xml")
+        ("config", po::value<std::string>(&config.config), "network configuration file (caffe prototxt)")
+        ("confidence", po::value<float>(&config.confidence)->default_value(config.confidence), "minimal confidence of a detected face (ssd backends)")
+        ("precision", po::value<std::string>(&mode.precision)->default_value(mode.precision), "inference precision: fp32, fp16 or int8")
+        ("dnn-backend", po::value<std::string>(&mode.backend)->default_value(mode.backend), "dnn backend: opencv, default, openvino or cuda")
+        ("dnn-target", po::value<std::string>(&mode.target), "dnn target: cpu, opencl or opencl_fp16 (by default follows the precision)")
+        ("quantize", po::value<bool>(&mode.quantize)->default_value(mode.quantize)->implicit_value(true)->zero_tokens(),
+         "int8: quantize the network on the reference clip instead of loading a quantized model")
+        ("reference-model", po::value<std::string>(&config.reference_model), "fp32 model a quantized int8 model is checked against (default: model of the backend)");
+}
+
+#endif // !DETECTOR_OPTIONS_HPP
@@ -0,0 +1,100 @@
+#ifndef EVALUATION_HPP
+#define EVALUATION_HPP
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Helpers comparing detected faces with reference boxes (ground truth or another detector)
+
+// reference boxes of every frame, by frame number
+typedef std::map<int, std::vector<cv::Rect>> FrameBoxes;
+
+//convert the flat list returned by FaceDetector into rectangles
+inline std::vector<cv::Rect> faces_to_rects(const std::vector<int> &faces) {
+    std::vector<cv::Rect> rects;
+    for (int i = 1; i + 3 <= faces[0]; i += 4)
+        rects.push_back(cv::Rect(faces[i], faces[i+1], faces[i+2], faces[i+3]));
+    return rects;
+}
+
+//intersection over union of two boxes
+inline double iou(const cv::Rect &a, const cv::Rect &b) {
+    double intersection = (a & b).area();
+    double sum = a.area() + b.area() - intersection;
+    return sum > 0 ? intersection / sum : 0.0;
+}
+
+//number of reference boxes matched by a different detected box with IoU of at least threshold
+inline int matched_count(const std::vector<cv::Rect> &reference, const std::vector<cv::Rect> &detected, double threshold = 0.5) {
+    std::vector<bool> used(detected.size(), false);
+    int matched = 0;
+    for (const auto &r : reference) {
+        int best = -1;
+        double best_iou = threshold;
+        for (size_t d = 0; d < detected.size(); ++d) {
+            double overlap = iou(r, detected[d]);
+            if (!used[d] && overlap >= best_iou) {
+                best = d;
+                best_iou = overlap;
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            matched++;
+        }
+    }
+    return matched;
+}
+
+// face pixels of the reference boxes hidden by censored boxes, see censure_coverage()
+struct CensureCoverage {
+    int64_t face_pixels = 0;            // pixels inside any reference box
+    int64_t censored_face_pixels = 0;   // of those, pixels inside any censored box
+    int64_t over_pixels = 0;            // censored pixels outside all reference boxes
+
+    int64_t leaked() const { return face_pixels - censored_face_pixels; }
+};
+
+//pixel accounting of the censure of a frame of the given size, overlapping boxes are counted once
+inline CensureCoverage censure_coverage(const std::vector<cv::Rect> &reference, const std::vector<cv::Rect> &censored, const cv::Size &frame) {
+    cv::Rect bounds(cv::Point(0, 0), frame);
+    cv::Mat faces = cv::Mat::zeros(frame, CV_8UC1);
+    cv::Mat hidden = cv::Mat::zeros(frame, CV_8UC1);
+    for (const auto &r : reference)
+        faces(r & bounds).setTo(255);
+    for (const auto &r : censored)
+        hidden(r & bounds).setTo(255);
+    cv::Mat both;
+    cv::bitwise_and(faces, hidden, both);
+
+    CensureCoverage coverage;
+    coverage.face_pixels = cv::countNonZero(faces);
+    coverage.censored_face_pixels = cv::countNonZero(both);
+    coverage.over_pixels = cv::countNonZero(hidden) - coverage.censored_face_pixels;
+    return coverage;
+}
+
+//ground truth file: one face per line as "frame x y width height", lines starting with # are skipped
+inline FrameBoxes load_ground_truth(const std::string &path) {
+    FrameBoxes boxes;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream is(line);
+        int frame;
+        cv::Rect r;
+        if (is >> frame >> r.x >> r.y >> r.width >> r.height)
+            boxes[frame].push_back(r);
+    }
+    return boxes;
+}
+
+#endif // !EVALUATION_HPP
@@ -0,0 +1,27 @@
+#ifndef IPC_HPP
+#define IPC_HPP
+
+#include <string>
+
+// IPC objects belonging to a single video stream get the stream number appended to their name,
+// so every stream has its own frame, faces and sync objects
+inline std::string streamName(const char * name, int stream) {
+    return std::string(name) + "_" + std::to_string(stream);
+}
+
+// removers make sure that IPC resource does get removed and we will not have errors creating a new one,
+// IpcObject is any boost::interprocess type with a static remove(name) (shmem, named mutex, message queue).
+// A process restarted by the supervisor in D (--reattach) reattaches to the objects the rest of the pipeline still
+// uses, so nothing is removed at its start.
+template <class IpcObject>
+struct IpcRemover {
+    std::string name;
+
+    explicit IpcRemover(const std::string & objectName, bool reattach = false) : name(objectName) {
+        if (!reattach)
+            IpcObject::remove(name.c_str());
+    }
+    ~IpcRemover() { IpcObject::remove(name.c_str()); }
+};
+
+#endif // !IPC_HPP
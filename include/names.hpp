@@ -4,21 +4,51 @@
 #define CAPTURE_OPEN_VALUE 0
 #define CAPTURE_OPEN_VALUE_2 -1
 #define SYNC_BC 1
+// upper limit of video streams handled by a single pipeline
+#define MAX_STREAMS 16
 #define SAVE_PROCESSING_TIME 0
-
+// when enabled A adapts its sending rate to the measured pipeline latency, the fps set in D is only an upper bound
+#define ADAPTIVE_RATE 1
+#define DEFAULT_LATENCY_SLO_MS 200
+#define RATE_CONTROL_PERIOD_MS 100
+// B lowers the detector input size when inference takes longer than this and raises it when there is room
+#define INFERENCE_BUDGET_MS 40
+// B polls the queues from A this often while no stream has a new frame
+#define FRAME_POLL_MS 1
+// sent by D after changing the CPU affinity of a process, which then resizes its thread pool (see ThreadBudget.hpp)
+#define AFFINITY_CHANGED_SIGNAL SIGUSR1
+
+// names of per-stream objects get the stream number appended (see streamName() in ipc.hpp)
 #define FRAME_SHMEM_NAME "ac_shmem"
 #define FRAME_MUTEX_NAME "ac_mutex"
 
-#define FRAMESIZE_SHMEM "framesize_shmem"
-#define FRAMESIZE_MUTEX "framesize_mutex"
-
 #define FACES_SHMEM_NAME "faces_shmem"
 #define FACES_MUTEX_NAME "faces_mutex"
 
+#define AB_SYNC_Q_NAME "ab_queue"
+#define BC_SYNC_Q_NAME "bc_queue"
+
+// objects shared by all streams
+
 #define CENSURE_MODE_Q_NAME "censure_mode_queue"
 
 #define FPS_Q_NAME "fps_queue"
 
-#define BC_SYNC_Q_NAME "bc_queue"
+#define SLO_Q_NAME "slo_queue"
+
+#define RESOLUTION_Q_NAME "resolution_queue"
+// detector options requested from D as one string, B loads the detector and switches to it between frames
+#define DETECTOR_Q_NAME "detector_queue"
+#define DETECTOR_REQUEST_SIZE 512
+// capture resolution (width and height) requested from D, A publishes frames in that size
+#define CAPTURE_RESOLUTION_Q_NAME "capture_resolution_queue"
+// NUMA node of the cores of B and C sent by D to A, which moves the frame buffers there
+#define NUMA_Q_NAME "numa_queue"
+// policy of the queues A -> B (applied by A) and B -> C (applied by B) requested from D, see StageQueue.hpp
+#define AB_POLICY_Q_NAME "ab_policy_queue"
+#define BC_POLICY_Q_NAME "bc_policy_queue"
+
+#define STATS_SHMEM_NAME "stats_shmem"
+#define STATS_MUTEX_NAME "stats_mutex"
 
 #endif // !NAMES_HPP
\ No newline at end of file
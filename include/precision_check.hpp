@@ -0,0 +1,80 @@
+#ifndef PRECISION_CHECK_HPP
+#define PRECISION_CHECK_HPP
+
+#include "FaceDetector.hpp"
+#include "evaluation.hpp"
+
+#include <opencv2/videoio.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Accuracy check of a reduced precision inference mode: detections on a reference clip are compared
+// with the ones of the same model running in fp32, the mode passes when both recall and precision
+// relative to fp32 reach the required agreement.
+
+struct PrecisionReport {
+    int frames = 0;
+    double recall = 1.0;
+    double precision = 1.0;
+    double reference_ms = 0.0;
+    double candidate_ms = 0.0;
+    bool passed = false;
+};
+
+//first max_frames frames of a video file
+inline std::vector<cv::Mat> read_clip(const std::string &path, int max_frames) {
+    std::vector<cv::Mat> clip;
+    cv::VideoCapture capture(path);
+    cv::Mat frame;
+    while ((int)clip.size() < max_frames && capture.read(frame))
+        clip.push_back(frame.clone());
+    return clip;
+}
+
+inline PrecisionReport check_precision(FaceDetector &reference, FaceDetector &candidate, const std::vector<cv::Mat> &clip, double min_agreement) {
+    PrecisionReport report;
+    long reference_faces = 0, candidate_faces = 0, matched = 0;
+    std::chrono::duration<double, std::milli> reference_time(0), candidate_time(0);
+
+    //warm up, the first forward pass allocates the network
+    if (!clip.empty()) {
+        reference.detected_face(clip[0]);
+        candidate.detected_face(clip[0]);
+    }
+
+    for (const auto &frame : clip) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<cv::Rect> expected = faces_to_rects(reference.detected_face(frame));
+        auto middle = std::chrono::steady_clock::now();
+        std::vector<cv::Rect> found = faces_to_rects(candidate.detected_face(frame));
+        candidate_time += std::chrono::steady_clock::now() - middle;
+        reference_time += middle - start;
+
+        reference_faces += expected.size();
+        candidate_faces += found.size();
+        matched += matched_count(expected, found);
+    }
+
+    report.frames = clip.size();
+    if (reference_faces > 0)
+        report.recall = (double)matched / reference_faces;
+    if (candidate_faces > 0)
+        report.precision = (double)matched / candidate_faces;
+    if (!clip.empty()) {
+        report.reference_ms = reference_time.count() / clip.size();
+        report.candidate_ms = candidate_time.count() / clip.size();
+    }
+    report.passed = !clip.empty() && report.recall >= min_agreement && report.precision >= min_agreement;
+    return report;
+}
+
+inline void print_precision_report(const PrecisionReport &report, const std::string &mode) {
+    std::cout << "Precision check of " << mode << " on " << report.frames << " frames: recall " << report.recall
+              << ", precision " << report.precision << " (relative to fp32), " << report.candidate_ms << " ms/frame vs "
+              << report.reference_ms << " ms/frame in fp32 -- " << (report.passed ? "PASSED" : "FAILED") << std::endl;
+}
+
+#endif // !PRECISION_CHECK_HPP
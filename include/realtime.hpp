@@ -0,0 +1,244 @@
+#ifndef REALTIME_HPP
+#define REALTIME_HPP
+
+#include "stats.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Helpers for real-time operation of the pipeline: SCHED_DEADLINE reservations set by process D,
+// memory locking and prefaulting in the children, and per-process counters of page faults and deadline overruns.
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE 6
+#endif
+// deadline tasks can't create threads unless their children are reset to SCHED_OTHER
+#ifndef SCHED_FLAG_RESET_ON_FORK
+#define SCHED_FLAG_RESET_ON_FORK 0x01
+#endif
+// the kernel sends SIGXCPU to a deadline task which used up its runtime before the end of the period
+#ifndef SCHED_FLAG_DL_OVERRUN
+#define SCHED_FLAG_DL_OVERRUN 0x04
+#endif
+
+// runtime of a stage is its measured cost per frame times this margin, limited by the period
+#define DEADLINE_RUNTIME_MARGIN 1.5
+// the kernel rejects runtimes below 1 us, workers which barely ran so far get this much
+#define DEADLINE_MIN_RUNTIME_MS 0.1
+
+// argument of the sched_setattr syscall, glibc doesn't provide a wrapper
+struct DeadlineAttr {
+    uint32_t size;
+    uint32_t sched_policy;
+    uint64_t sched_flags;
+    int32_t sched_nice;
+    uint32_t sched_priority;
+    // all in nanoseconds
+    uint64_t sched_runtime;
+    uint64_t sched_deadline;
+    uint64_t sched_period;
+};
+
+//CPU time (user + system, in clock ticks) of a process, or of one of its threads when tid is given; -1 when it is gone
+inline double task_cpu_ticks(pid_t pid, pid_t tid = 0) {
+    std::string path = "/proc/" + std::to_string(pid) + (tid > 0 ? "/task/" + std::to_string(tid) : std::string()) + "/stat";
+    std::ifstream file(path);
+    std::string line;
+    if (!std::getline(file, line) || line.rfind(')') == std::string::npos)
+        return -1;
+    //the name in parentheses may contain spaces, utime and stime are the 12th and 13th fields after it
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    double utime = 0, stime = 0;
+    for (int i = 1; i <= 13 && fields >> field; ++i) {
+        if (i == 12)
+            utime = atof(field.c_str());
+        else if (i == 13)
+            stime = atof(field.c_str());
+    }
+    return utime + stime;
+}
+
+//threads of a process, listed in /proc/<pid>/task
+inline std::vector<pid_t> process_threads(pid_t pid) {
+    std::vector<pid_t> threads;
+    DIR *tasks = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (tasks == NULL)
+        return threads;
+    while (dirent *task = readdir(tasks)) {
+        pid_t tid = atoi(task->d_name);
+        if (tid > 0)
+            threads.push_back(tid);
+    }
+    closedir(tasks);
+    return threads;
+}
+
+//scheduling attributes of a thread, false when it can't be read (e.g. the thread is gone)
+inline bool thread_scheduling(pid_t tid, DeadlineAttr &attr) {
+    memset(&attr, 0, sizeof(attr));
+    return syscall(SYS_sched_getattr, tid, &attr, sizeof(DeadlineAttr), 0) == 0;
+}
+
+// Sets the scheduling attributes of the given threads, all or nothing: when a thread is rejected, the threads switched
+// already get their previous attributes back. Threads that exited in the meantime are skipped.
+inline bool set_thread_scheduling(const std::vector<pid_t> &threads, const std::vector<DeadlineAttr> &attrs, const char *hint) {
+    std::vector<DeadlineAttr> previous(threads.size());
+    std::vector<bool> alive(threads.size(), true);
+    for (size_t i = 0; i < threads.size(); ++i)
+        alive[i] = thread_scheduling(threads[i], previous[i]);
+
+    for (size_t i = 0; i < threads.size(); ++i) {
+        if (!alive[i] || syscall(SYS_sched_setattr, threads[i], &attrs[i], 0) == 0 || errno == ESRCH)
+            continue;
+
+        std::cerr << "Error: could not set the scheduling of thread " << threads[i] << ": " << strerror(errno) << " (" << hint << ")" << std::endl;
+        for (size_t j = 0; j < i; ++j)
+            if (alive[j] && syscall(SYS_sched_setattr, threads[j], &previous[j], 0) != 0 && errno != ESRCH)
+                std::cerr << "Error: could not restore the scheduling of thread " << threads[j] << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Give every thread of the process the policy (and priority for FIFO and RR). The work of A and C runs in per-stream
+// threads and B uses a thread pool, so changing only the main thread would leave the work as it was; SCHED_DEADLINE
+// reservations of the workers are released as well. Threads started later inherit the policy from their creator.
+inline bool set_policy(pid_t pid, int policy, int priority) {
+    DeadlineAttr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.sched_policy = policy;
+    attr.sched_priority = (policy == SCHED_FIFO || policy == SCHED_RR) ? priority : 0;
+    std::vector<pid_t> threads = process_threads(pid);
+    if (threads.empty()) {
+        std::cerr << "Error: process " << pid << " is not running" << std::endl;
+        return false;
+    }
+    return set_thread_scheduling(threads, std::vector<DeadlineAttr>(threads.size(), attr), "FIFO and RR require sudo");
+}
+
+// Give the worker threads of a stage SCHED_DEADLINE reservations: runtime of CPU time within each period, finished
+// before the deadline, each thread with its own runtime. Every worker of A and C handles one frame of its stream per
+// period, the worker of B one batch; listener threads and the OpenCV pool stay in their current class.
+// All or nothing: when a thread is rejected (affinity not spanning all CPUs, admission control out of bandwidth),
+// the threads switched already get their previous scheduling back.
+inline bool set_deadline(const std::vector<pid_t> &threads, const std::vector<double> &runtimes_ms, double deadline_ms, double period_ms) {
+    std::vector<DeadlineAttr> attrs(threads.size());
+    for (size_t i = 0; i < threads.size(); ++i) {
+        DeadlineAttr &attr = attrs[i];
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.sched_policy = SCHED_DEADLINE;
+        attr.sched_flags = SCHED_FLAG_DL_OVERRUN | SCHED_FLAG_RESET_ON_FORK;
+        attr.sched_runtime = (uint64_t)(runtimes_ms[i] * 1e6);
+        attr.sched_deadline = (uint64_t)(deadline_ms * 1e6);
+        attr.sched_period = (uint64_t)(period_ms * 1e6);
+    }
+    return set_thread_scheduling(threads, attrs, "requires sudo, affinity to all CPUs and free bandwidth");
+}
+
+// Per-process real-time setup and measurements. Counts SIGXCPU signals sent on deadline overruns and samples
+// page faults and CPU time per frame with getrusage().
+class RealtimeMonitor {
+private:
+    int64_t last_frames;
+    double last_cpu_ms;
+    int64_t last_minor_faults;
+    std::chrono::steady_clock::time_point last_sample;
+
+    static volatile sig_atomic_t & overruns() {
+        static volatile sig_atomic_t count = 0;
+        return count;
+    }
+
+    //SIGXCPU would terminate the process by default
+    static void handle_overrun(int sig) {
+        overruns() = overruns() + 1;
+    }
+
+public:
+    RealtimeMonitor() : last_frames(0), last_sample(std::chrono::steady_clock::now()) {
+        signal(SIGXCPU, handle_overrun);
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        last_cpu_ms = cpu_time_ms(usage);
+        last_minor_faults = usage.ru_minflt;
+    }
+
+    static double cpu_time_ms(const rusage &usage) {
+        return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0
+             + usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+    }
+
+    //forget the worker threads of a previous run of the process (restarted by D), the caller holds the stats mutex
+    static void clear_workers(ProcessStats &process) {
+        process.workerThreads = 0;
+    }
+
+    //register the calling thread as a worker handling frames, D gives only workers a deadline reservation;
+    //the caller holds the stats mutex
+    static void add_worker(ProcessStats &process) {
+        if (process.workerThreads < MAX_WORKER_THREADS)
+            process.workerTids[process.workerThreads++] = syscall(SYS_gettid);
+    }
+
+    //lock all current and future pages, so the steady state runs without page faults
+    bool lock_memory() {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            std::cerr << "Error: could not lock memory: " << strerror(errno) << " (requires sudo or a higher RLIMIT_MEMLOCK)" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    //touch every page of a mapped region, so the first frames don't pay for mapping them
+    static void prefault(const void *address, size_t size) {
+        const volatile unsigned char *bytes = static_cast<const volatile unsigned char*>(address);
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t offset = 0; offset < size; offset += page)
+            (void)bytes[offset];
+    }
+
+    //update the counters of the process, frames is the number of frames (or batches) handled so far.
+    //Sampled at most every RATE_CONTROL_PERIOD_MS, the caller holds the stats mutex.
+    void sample(ProcessStats &process, int64_t frames) {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed_s = std::chrono::duration<double>(now - last_sample).count();
+        if (elapsed_s * 1000.0 < RATE_CONTROL_PERIOD_MS)
+            return;
+
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        double cpu_ms = cpu_time_ms(usage);
+        if (frames > last_frames)
+            updateAverage(process.frameCpuMs, (cpu_ms - last_cpu_ms) / (frames - last_frames));
+        process.minorFaultsPerSec = (usage.ru_minflt - last_minor_faults) / elapsed_s;
+        process.minorFaults = usage.ru_minflt;
+        process.majorFaults = usage.ru_majflt;
+        process.deadlineOverruns = overruns();
+
+        last_frames = frames;
+        last_cpu_ms = cpu_ms;
+        last_minor_faults = usage.ru_minflt;
+        last_sample = now;
+    }
+};
+
+#endif // !REALTIME_HPP
@@ -0,0 +1,90 @@
+#ifndef SOAK_HPP
+#define SOAK_HPP
+
+#include "stats.hpp"
+#include "RobustMutex.hpp"
+#include "realtime.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// period of the wake-up probe, like the default interval of cyclictest
+#define SOAK_PROBE_PERIOD_US 1000
+// number of wake-ups collected locally before they are added to the stats shmem (once a second)
+#define SOAK_PROBE_FLUSH 1000
+
+// Wake-up latency probe of a process used in soak runs, measured the way cyclictest does it: a thread sleeps until an
+// absolute time every SOAK_PROBE_PERIOD_US and records how late it woke up. The thread follows the scheduling policy
+// D sets on the main thread of the process, so the jitter is measured under the same policy as the stage itself.
+class WakeupProbe {
+private:
+    ProcessStats *process;
+    RobustMutex &mutex;
+
+    static int64_t now_ns() {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000LL + now.tv_nsec;
+    }
+
+    //same policy and priority as the main thread, deadline reservations are not copied
+    static void follow_main_thread() {
+        int policy = sched_getscheduler(getpid());
+        sched_param parameter;
+        if (policy < 0 || policy == SCHED_DEADLINE || sched_getparam(getpid(), &parameter) != 0)
+            return;
+        pthread_setschedparam(pthread_self(), policy, &parameter);
+    }
+
+    void run() {
+        int64_t histogram[WAKEUP_BUCKETS] = {0};
+        double sum_us = 0.0, max_us = 0.0;
+        int64_t count = 0;
+
+        timespec next;
+        clock_gettime(CLOCK_MONOTONIC, &next);
+        while (true) {
+            next.tv_nsec += SOAK_PROBE_PERIOD_US * 1000;
+            while (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                ++next.tv_sec;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+            double late_us = (now_ns() - (next.tv_sec * 1000000000LL + next.tv_nsec)) / 1000.0;
+
+            histogram[std::min(WAKEUP_BUCKETS - 1, (int)(late_us / WAKEUP_BUCKET_US))]++;
+            sum_us += late_us;
+            max_us = std::max(max_us, late_us);
+            if (++count < SOAK_PROBE_FLUSH)
+                continue;
+
+            mutex.lock();
+            WakeupStats &wakeup = process->wakeup;
+            wakeup.avgUs = (wakeup.avgUs * wakeup.count + sum_us) / (wakeup.count + count);
+            wakeup.count += count;
+            wakeup.maxUs = std::max(wakeup.maxUs, max_us);
+            for (int i = 0; i < WAKEUP_BUCKETS; ++i) {
+                wakeup.histogram[i] += histogram[i];
+                histogram[i] = 0;
+            }
+            mutex.unlock();
+            sum_us = max_us = 0.0;
+            count = 0;
+            follow_main_thread();
+        }
+    }
+
+public:
+    //the probe runs until the process exits
+    WakeupProbe(ProcessStats *processStats, RobustMutex &statsMutex) : process(processStats), mutex(statsMutex) {
+        std::thread(&WakeupProbe::run, this).detach();
+    }
+};
+
+#endif // !SOAK_HPP
@@ -0,0 +1,166 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <cstdint>
+
+#include "names.hpp"
+
+// weight of the newest sample in the moving averages kept below
+#define STATS_EWMA_ALPHA 0.1
+// capture-to-display latencies are counted in 1 ms buckets, the last one collects all longer latencies
+#define LATENCY_BUCKETS 1000
+// wake-up latencies of the soak probe are counted in 10 us buckets up to 10 ms
+#define WAKEUP_BUCKETS 1000
+#define WAKEUP_BUCKET_US 10
+// worker threads of a process: one per stream, plus the display loop of C
+#define MAX_WORKER_THREADS (MAX_STREAMS + 1)
+
+// bounded queue between two stages (see StageQueue.hpp), reported by its producer except for superseded items
+struct QueueStats {
+    int policy;             // QUEUE_LATEST_WINS, QUEUE_BLOCK or QUEUE_EVERY_NTH
+    int nth;
+    int64_t pushed;
+    int64_t dropped;        // items dropped by the policy
+    int64_t superseded;     // items skipped by the consumer, it had processed a newer frame already
+    double occupancy;       // average number of items waiting when an item was pushed
+    int maxOccupancy;
+    double blockedMs;       // total time the producer waited for room
+};
+
+// Measurements of a single video stream
+struct StreamStats {
+    // process A
+    double publishFps;      // sending rate currently chosen by the rate controller
+    int64_t framesPublished;
+    int frameCols;          // size of the frames A publishes
+    int frameRows;
+    int formatVersion;      // incremented by A with every change of the frame format
+    int pixelFormat;        // PIXEL_BGR or the native format of the camera (see PixelFormat.hpp)
+    int64_t frameBytes;     // size of a frame in the frame buffer
+    double writtenBytes;    // bytes A wrote into the frame buffer per frame, less than frameBytes when it publishes deltas
+    double changedTiles;    // share of the tiles of a frame that changed since the previous frame (1 without deltas)
+
+    // process B
+    int64_t framesDetected;
+    int64_t framesShed;     // frames skipped by the scheduler because the inference budget was exceeded
+    int64_t framesGated;    // frames whose faces were reused since too little changed since the last detection
+
+    // queues A -> B and B -> C
+    QueueStats abQueue;
+    QueueStats bcQueue;
+
+    // process C
+    double convertMs;       // average time of taking a frame out of the frame buffer (a copy, or conversion of native frames)
+    double renderMs;        // average time of censuring and displaying a frame
+    double latencyMs;       // average time between frame capture in A and its display in C
+    int64_t framesDisplayed;
+    int64_t framesOverwritten;  // frames with faces from B that A had overwritten before C could draw them
+    double maxFrameGapMs;   // longest time between two displayed frames (stall)
+    int64_t lastCaptureMs;  // capture time (ms since epoch) of the last displayed frame
+};
+
+// performance counters of a process (see PerfCounters.hpp), index into PerfStats::perFrame
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_MISSES 2
+#define PERF_BRANCH_MISSES 3
+#define PERF_CONTEXT_SWITCHES 4
+#define PERF_COUNTERS 5
+
+// state of the counters: not requested, all counting, some or none permitted by the kernel
+#define PERF_OFF 0
+#define PERF_ON 1
+#define PERF_PARTIAL 2
+#define PERF_DENIED 3
+
+struct PerfStats {
+    int state;
+    double perFrame[PERF_COUNTERS];     // average count per frame (per batch in B) of every counter
+};
+
+// wake-up latency of a process measured by the soak probe (see soak.hpp)
+struct WakeupStats {
+    int64_t count;
+    double avgUs;
+    double maxUs;
+    int64_t histogram[WAKEUP_BUCKETS];
+};
+
+// Real-time measurements of one of the processes A, B and C
+struct ProcessStats {
+    int memoryLocked;           // mlockall succeeded
+    double frameCpuMs;          // average CPU time of the whole process per frame (per batch in B)
+    int64_t minorFaults;
+    int64_t majorFaults;
+    double minorFaultsPerSec;   // in the last sampling period, should be close to 0 in the steady state
+    int64_t deadlineOverruns;   // SIGXCPU signals received under SCHED_DEADLINE
+    int workerThreads;          // threads handling frames (a stream each in A and C, the detection loop in B)
+    int32_t workerTids[MAX_WORKER_THREADS];
+    PerfStats perf;
+    WakeupStats wakeup;
+    // written by the supervisor in D
+    int restarts;           // times the process was restarted after a crash
+    double recoveryMs;      // time from the last crash until C displayed a frame captured after it
+};
+
+// index of the process in PipelineStats::process
+#define PROCESS_A 0
+#define PROCESS_B 1
+#define PROCESS_C 2
+
+// Measurements of every stage of the pipeline, kept in shared memory (STATS_SHMEM_NAME).
+// The block is created by process D, each process writes only its own fields and D displays them in the menu.
+// Only primitive values are stored, since objects of custom classes in shmem cause multiple problems.
+struct PipelineStats {
+    int streams;
+
+    // process A
+    double latencySloMs;    // end-to-end latency target the rate controller aims for
+
+    // process B
+    double inferenceMs;     // average time of a single (batched) forward pass
+    int inputSize;          // current width and height of the detection network input
+    int batchSize;          // number of streams in the last batch
+    double prepareMs;       // average time of scaling native frames of a batch and converting them to BGR
+    int detectorSwaps;      // detectors replaced at runtime, the rest describes the last replacement
+    double swapPrepareMs;   // loading and warming up the new detector, while the old one kept detecting
+    double swapSwitchMs;    // time the main loop of B spent switching
+    double swapBlipMs;      // increase of the inference time right after the switch
+
+    StreamStats stream[MAX_STREAMS];
+    ProcessStats process[3];
+
+    // process C, latencies of all streams
+    int64_t latencyHistogram[LATENCY_BUCKETS];
+};
+
+// exponentially weighted moving average, the first sample initializes it
+inline void updateAverage(double & average, double sample) {
+    if (average == 0.0)
+        average = sample;
+    else
+        average += STATS_EWMA_ALPHA * (sample - average);
+}
+
+inline void recordLatency(PipelineStats * stats, double latencyMs) {
+    int bucket = latencyMs < 0 ? 0 : (int)latencyMs;
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    stats->latencyHistogram[bucket]++;
+}
+
+// latency (ms) below which the given fraction of frames recorded between two snapshots of the histogram falls
+inline int latencyPercentile(const int64_t * before, const int64_t * after, double fraction) {
+    int64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i)
+        total += after[i] - before[i];
+    int64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += after[i] - before[i];
+        if (total > 0 && seen >= fraction * total)
+            return i + 1;
+    }
+    return 0;
+}
+
+#endif // !STATS_HPP
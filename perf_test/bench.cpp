@@ -0,0 +1,218 @@
+// Microbenchmarks of the building blocks of the pipeline: face detection (B), censure (C), the transfer of a
+// frame from A to its readers and the conversions a frame of a YUV camera goes through. Cases are parameterized over
+// frame resolution, face count, box size, censure mode, IPC mechanism and pixel format. Run them through the bench target, which saves JSON results in the Google Benchmark format,
+// and compare two runs with perf_test/bench_compare.py.
+// usage: bench.out [--benchmark_filter=<regex>] [--benchmark_min_time=<s>] [--benchmark_out=<file>] [--benchmark_format=json]
+
+#include "names.hpp"
+#include "ipc.hpp"
+#include "FaceDetector.hpp"
+#include "BlurDrawer.hpp"
+#include "FrameBuffer.hpp"
+#include "PixelFormat.hpp"
+#include "RobustMutex.hpp"
+#include "Microbench.hpp"
+
+#include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/named_mutex.hpp>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define BENCH_FRAME_NAME "bench_frame"
+#define BENCH_MUTEX_NAME "bench_mutex"
+
+using namespace boost::interprocess;
+
+
+struct Resolution {
+    int width;
+    int height;
+    std::string name() const { return std::to_string(width) + "x" + std::to_string(height); }
+};
+
+//noise with bright ellipses in place of faces
+cv::Mat synthetic_frame(const Resolution &resolution, int faces) {
+    cv::Mat frame(resolution.height, resolution.width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    for (int i = 0; i < faces; ++i) {
+        cv::Point center((i + 1) * resolution.width / (faces + 1), resolution.height / 2);
+        cv::ellipse(frame, center, cv::Size(40, 52), 0, 0, 360, cv::Scalar(150, 170, 210), -1);
+    }
+    return frame;
+}
+
+//faces of the given size spread over the frame in a grid, clipped to the frame
+std::vector<cv::Rect> face_boxes(const Resolution &resolution, int faces, int box) {
+    std::vector<cv::Rect> boxes;
+    int columns = std::max(1, resolution.width / box);
+    for (int i = 0; i < faces; ++i) {
+        cv::Rect r((i % columns) * box, (i / columns) * box % std::max(1, resolution.height - box), box, box);
+        boxes.push_back(r & cv::Rect(0, 0, resolution.width, resolution.height));
+    }
+    return boxes;
+}
+
+
+// B: detection of a single frame
+void register_detection(Microbench &bench, FaceDetector &detector) {
+    for (Resolution resolution : {Resolution{640, 480}, Resolution{1280, 720}, Resolution{1920, 1080}})
+        for (int faces : {0, 4}) {
+            std::string name = "BM_Detect/" + resolution.name() + "/faces:" + std::to_string(faces);
+            bench.add(name, [&detector, resolution, faces](BenchState &state) {
+                cv::Mat frame = synthetic_frame(resolution, faces);
+                while (state.keep_running())
+                    detector.detected_face(frame);
+                state.items_processed = state.iteration_count();
+            });
+        }
+}
+
+// C: copy of the frame and censure of all faces, as done for every frame in C
+void register_censure(Microbench &bench) {
+    const char *modes[] = {"rectangle", "blur"};
+    for (int mode : {0, 1})
+        for (Resolution resolution : {Resolution{1280, 720}, Resolution{1920, 1080}})
+            for (int faces : {1, 4, 16})
+                for (int box : {32, 96, 256}) {
+                    std::string name = std::string("BM_Censure/") + modes[mode] + "/" + resolution.name()
+                                     + "/faces:" + std::to_string(faces) + "/box:" + std::to_string(box);
+                    bench.add(name, [mode, resolution, faces, box](BenchState &state) {
+                        cv::Mat frame = synthetic_frame(resolution, 0);
+                        std::vector<cv::Rect> boxes = face_boxes(resolution, faces, box);
+                        BlurDrawer drawer;
+                        drawer.set_mode(mode);
+                        while (state.keep_running()) {
+                            drawer.set_draw_info(frame, boxes);
+                            drawer.draw();
+                        }
+                        state.items_processed = state.iteration_count();
+                    });
+                }
+}
+
+// A -> B/C: publishing a frame with its timestamp and reading it back as a Mat
+template <class Mutex>
+void publish_and_read(BenchState &state, void *buffer, Mutex &mutex, const cv::Mat &frame) {
+    size_t bytes = frame.total() * frame.elemSize();
+    int64_t timestamp = 0;
+    cv::Mat copy;
+    while (state.keep_running()) {
+        mutex.lock();
+        memcpy(buffer, &timestamp, sizeof(int64_t));
+        memcpy((unsigned char*)buffer + sizeof(int64_t), frame.data, bytes);
+        mutex.unlock();
+
+        mutex.lock();
+        cv::Mat img(frame.rows, frame.cols, frame.type(), (unsigned char*)buffer + sizeof(int64_t));
+        img.copyTo(copy);
+        mutex.unlock();
+        ++timestamp;
+    }
+    state.bytes_processed = 2 * bytes * state.iteration_count();
+}
+
+void register_ipc(Microbench &bench) {
+    for (Resolution resolution : {Resolution{1280, 720}, Resolution{1920, 1080}, Resolution{3840, 2160}}) {
+        size_t bytes = (size_t)resolution.width * resolution.height * 3 + sizeof(int64_t);
+
+        for (FramePages pages : {PAGES_AUTO, PAGES_SMALL}) {
+            std::string name = std::string("BM_Ipc/") + (pages == PAGES_AUTO ? "framebuffer_hugepages" : "framebuffer_small_pages")
+                             + "/" + resolution.name();
+            bench.add(name, [resolution, bytes, pages](BenchState &state) {
+                IpcRemover<FrameBuffer> bufferRemover(BENCH_FRAME_NAME);
+                IpcRemover<RobustMutex> mutexRemover(BENCH_MUTEX_NAME);
+                FrameBuffer buffer(create_only, BENCH_FRAME_NAME, bytes, -1, pages);
+                RobustMutex mutex(create_only, BENCH_MUTEX_NAME);
+                publish_and_read(state, buffer.get_address(), mutex, synthetic_frame(resolution, 0));
+            });
+        }
+
+        //shared memory and lock used before FrameBuffer and RobustMutex
+        bench.add("BM_Ipc/boost_shmem_named_mutex/" + resolution.name(), [resolution, bytes](BenchState &state) {
+            IpcRemover<shared_memory_object> shmemRemover(BENCH_FRAME_NAME);
+            IpcRemover<named_mutex> mutexRemover(BENCH_MUTEX_NAME);
+            shared_memory_object shmem(create_only, BENCH_FRAME_NAME, read_write);
+            shmem.truncate(bytes);
+            mapped_region region(shmem, read_write);
+            named_mutex mutex(create_only, BENCH_MUTEX_NAME);
+            publish_and_read(state, region.get_address(), mutex, synthetic_frame(resolution, 0));
+        });
+
+        //every frame sent through a message queue instead of shared memory
+        bench.add("BM_Ipc/message_queue/" + resolution.name(), [resolution, bytes](BenchState &state) {
+            IpcRemover<message_queue> queueRemover(BENCH_FRAME_NAME);
+            message_queue queue(create_only, BENCH_FRAME_NAME, 1, bytes);
+            cv::Mat frame = synthetic_frame(resolution, 0);
+            std::vector<unsigned char> message(bytes), received(bytes);
+            unsigned int priority;
+            message_queue::size_type received_size;
+            cv::Mat copy;
+            while (state.keep_running()) {
+                memcpy(message.data() + sizeof(int64_t), frame.data, bytes - sizeof(int64_t));
+                queue.send(message.data(), bytes, 0);
+                queue.receive(received.data(), bytes, received_size, priority);
+                cv::Mat img(frame.rows, frame.cols, frame.type(), received.data() + sizeof(int64_t));
+                img.copyTo(copy);
+            }
+            state.bytes_processed = 2 * (bytes - sizeof(int64_t)) * state.iteration_count();
+        });
+    }
+}
+
+// A -> B -> C: what happens to a frame of a YUYV or NV12 camera, published as BGR (converted by VideoCapture in A,
+// scaled to the detector input in B and copied in C) or in the native format (scaled in YUV and converted at the
+// detector input size in B, converted once in C); frame_bytes are the bytes written into the frame buffer
+void register_frame_path(Microbench &bench) {
+    //default input size of the detector in B
+    const cv::Size input(300, 300);
+    for (int camera : {PIXEL_YUYV, PIXEL_NV12})
+        for (bool native : {false, true})
+            for (Resolution resolution : {Resolution{640, 480}, Resolution{1280, 720}, Resolution{1920, 1080}}) {
+                std::string name = std::string("BM_FramePath/") + pixel_format_name(camera) + "_camera/"
+                                 + (native ? "native/" : "bgr/") + resolution.name();
+                bench.add(name, [camera, native, resolution, input](BenchState &state) {
+                    cv::Mat captured;
+                    bgr_to_native(synthetic_frame(resolution, 0), camera, captured);
+                    int published = native ? camera : PIXEL_BGR;
+                    int type = pixel_mat_type(published, CV_8UC3);
+                    size_t bytes = pixel_bytes(published, resolution.height, resolution.width, type);
+                    std::vector<unsigned char> buffer(bytes);
+                    cv::Mat stored(pixel_mat_rows(published, resolution.height), resolution.width, type, buffer.data());
+                    cv::Mat bgr, detectorInput, shown;
+                    while (state.keep_running()) {
+                        if (native)
+                            memcpy(buffer.data(), captured.data, bytes);
+                        else {
+                            to_bgr(captured, camera, bgr);
+                            memcpy(buffer.data(), bgr.data, bytes);
+                        }
+                        scaled_bgr(stored, published, input, detectorInput);
+                        to_bgr(stored, published, shown);
+                    }
+                    state.counters["frame_bytes"] = bytes;
+                    state.bytes_processed = bytes * state.iteration_count();
+                    state.items_processed = state.iteration_count();
+                });
+            }
+}
+
+
+int main(int argc, char **argv) {
+    std::unique_ptr<FaceDetector> detector = make_face_detector(DetectorConfig());
+
+    Microbench bench;
+    register_detection(bench, *detector);
+    register_censure(bench);
+    register_ipc(bench);
+    register_frame_path(bench);
+    return bench.run(argc, argv);
+}
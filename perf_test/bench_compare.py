@@ -0,0 +1,43 @@
+# Compares two JSON results of the bench target (Google Benchmark format) and reports regressions.
+# usage: python3 bench_compare.py baseline.json contender.json [threshold_percent]
+# The exit code is 1 when any benchmark got slower than the threshold (default 10%), so it can gate a release.
+import json
+import sys
+
+
+def load(path):
+    with open(path, 'r') as fp:
+        results = json.load(fp)
+    return {b['name']: b for b in results['benchmarks'] if b.get('run_type', 'iteration') == 'iteration'}
+
+
+if len(sys.argv) < 3:
+    print('usage: python3 bench_compare.py baseline.json contender.json [threshold_percent]')
+    sys.exit(2)
+
+baseline = load(sys.argv[1])
+contender = load(sys.argv[2])
+threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 10.0
+
+regressions = 0
+print(f'{"Benchmark":<60}{"baseline_ns":>15}{"contender_ns":>15}{"change_%":>10}')
+for name in baseline:
+    if name not in contender:
+        print(f'{name:<60}{baseline[name]["real_time"]:>15.0f}{"missing":>15}')
+        continue
+    old = baseline[name]['real_time']
+    new = contender[name]['real_time']
+    change = (new - old) / old * 100.0 if old > 0 else 0.0
+    flag = ''
+    if change > threshold:
+        flag = '  REGRESSION'
+        regressions += 1
+    elif change < -threshold:
+        flag = '  improvement'
+    print(f'{name:<60}{old:>15.0f}{new:>15.0f}{change:>10.1f}{flag}')
+for name in contender:
+    if name not in baseline:
+        print(f'{name:<60}{"new":>15}{contender[name]["real_time"]:>15.0f}')
+
+print(f'{regressions} regressions over {threshold}%')
+sys.exit(1 if regressions else 0)
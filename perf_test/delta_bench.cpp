@@ -0,0 +1,135 @@
+// Cost of publishing frames of a static camera whole compared with writing only the tiles that changed (A --delta).
+// Frames of the given video (footage of a static camera) or of synthetic scenes, a fixed background with a moving
+// face at 1080p and 4K, with and without sensor noise, are published into a frame buffer the way A does it. For both
+// modes it reports the bytes written per frame, the share of changed tiles, the CPU time of A per frame (comparison
+// and copy) and the time the frame buffer stays locked. Noise changes every tile, so that case shows the price of
+// the comparison when deltas don't help.
+// usage: delta_bench.out [video] [frames]
+
+#include "ipc.hpp"
+#include "FrameBuffer.hpp"
+#include "FrameFormat.hpp"
+#include "FramePublisher.hpp"
+#include "RobustMutex.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BENCH_FRAME_NAME "delta_bench_frame"
+#define BENCH_MUTEX_NAME "delta_bench_mutex"
+
+using namespace boost::interprocess;
+
+
+double thread_cpu_ms() {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec * 1e3 + time.tv_nsec / 1e6;
+}
+
+struct Result {
+    double bytesPerFrame;
+    double changedShare;
+    double cpuMs;
+    double lockMs;
+};
+
+// publishes the frames returned by next (empty at the end) as A does, only the publishing is measured
+Result publish(const std::function<cv::Mat(int)> &next, int frames, bool delta) {
+    IpcRemover<FrameBuffer> bufferRemover(BENCH_FRAME_NAME);
+    IpcRemover<RobustMutex> mutexRemover(BENCH_MUTEX_NAME);
+    cv::Mat frame = next(0);
+    FrameBuffer buffer(create_only, BENCH_FRAME_NAME, sizeof(FrameSlotHeader) + frame.total() * frame.elemSize());
+    RobustMutex mutex(create_only, BENCH_MUTEX_NAME);
+    FrameFormat format = FrameFormat::of(frame, PIXEL_BGR, 1);
+    FramePublisher publisher(delta);
+
+    Result result = {0, 0, 0, 0};
+    int published = 0;
+    for (int i = 0; i < frames && !frame.empty(); ++i, frame = next(i)) {
+        double cpuStart = thread_cpu_ms();
+        publisher.prepare(frame, format, buffer.get_address());
+        mutex.lock();
+        auto lockStart = std::chrono::steady_clock::now();
+        size_t written = publisher.publish(frame, format, i, buffer.get_address());
+        std::chrono::duration<double, std::milli> locked = std::chrono::steady_clock::now() - lockStart;
+        mutex.unlock();
+        result.cpuMs += thread_cpu_ms() - cpuStart;
+        result.lockMs += locked.count();
+        result.bytesPerFrame += written;
+        result.changedShare += (double)publisher.changed_tiles() / publisher.tiles();
+        ++published;
+    }
+    if (published > 0) {
+        result.bytesPerFrame /= published;
+        result.changedShare /= published;
+        result.cpuMs /= published;
+        result.lockMs /= published;
+    }
+    return result;
+}
+
+void print(const std::string &footage, const Result &full, const Result &delta) {
+    for (const Result *r : {&full, &delta})
+        std::cout << footage << "\t" << (r == &full ? "full" : "delta") << "\t" << r->bytesPerFrame / 1024 << "\t"
+                  << r->changedShare * 100 << "\t" << r->cpuMs << "\t" << r->lockMs << std::endl;
+}
+
+// static camera: a fixed textured background with a face moving across it, optionally with sensor noise
+std::function<cv::Mat(int)> static_camera(cv::Size size, bool noise) {
+    cv::Mat background(size, CV_8UC3);
+    cv::randu(background, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(background, background, cv::Size(15, 15), 0);
+    return [background, noise](int i) {
+        cv::Mat frame = background.clone();
+        cv::Point center(100 + (i * 8) % std::max(1, frame.cols - 200), frame.rows / 2);
+        cv::ellipse(frame, center, cv::Size(40, 52), 0, 0, 360, cv::Scalar(150, 170, 210), -1);
+        if (noise) {
+            cv::Mat grain(frame.size(), CV_8UC3);
+            cv::randu(grain, cv::Scalar::all(0), cv::Scalar::all(3));
+            cv::add(frame, grain, frame);
+        }
+        return frame;
+    };
+}
+
+
+int main(int argc, char **argv) {
+    std::string video = argc > 1 ? argv[1] : "";
+    int frames = argc > 2 ? atoi(argv[2]) : 300;
+
+    std::cout << frames << " frames per case" << std::endl;
+    std::cout << "footage\tmode\tkB_written\tchanged_%\tcpu_ms\tlock_ms" << std::endl;
+
+    if (!video.empty()) {
+        //the video is read again for every mode, so both publish the same frames
+        Result results[2];
+        for (bool delta : {false, true}) {
+            cv::VideoCapture capture(video);
+            if (!capture.isOpened()) {
+                std::cerr << "Error: could not open " << video << std::endl;
+                return 1;
+            }
+            results[delta] = publish([&capture](int) { cv::Mat frame; capture.read(frame); return frame; }, frames, delta);
+        }
+        print(video, results[0], results[1]);
+        return 0;
+    }
+
+    for (cv::Size size : {cv::Size(1920, 1080), cv::Size(3840, 2160)}) {
+        for (bool noise : {false, true}) {
+            std::string footage = std::to_string(size.width) + "x" + std::to_string(size.height) + (noise ? "_noise" : "_static");
+            print(footage, publish(static_camera(size, noise), frames, false), publish(static_camera(size, noise), frames, true));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+// Comparative benchmark of the face detector backends on a replayed video.
+// Every backend detects faces in the same frames, the report contains latency, throughput, recall and precision,
+// measured against a ground truth file (see evaluation.hpp) or, without one, against the detections of the caffe backend.
+// usage: detector_bench.out --video file [--ground-truth file] [--backends caffe,onnx,haar,lbp] [--onnx-model file] [--frames n] [--input-size n]
+
+#include "FaceDetector.hpp"
+#include "evaluation.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+struct BackendResult {
+    std::vector<double> latencies;
+    long reference_faces = 0;
+    long detected_faces = 0;
+    long matched_faces = 0;
+};
+
+std::vector<std::vector<cv::Rect>> detect_all(FaceDetector &detector, const std::vector<cv::Mat> &frames, BackendResult &result) {
+    std::vector<std::vector<cv::Rect>> detections;
+
+    //warm up, the first forward pass allocates the network
+    detector.detected_face(frames[0]);
+
+    for (const auto &frame : frames) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<int> faces = detector.detected_face(frame);
+        result.latencies.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        detections.push_back(faces_to_rects(faces));
+    }
+    return detections;
+}
+
+
+int main(int argc, char **argv) {
+    std::string video, groundTruth, backendList, onnxModel;
+    int maxFrames, inputSize;
+
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("video", po::value<std::string>(&video)->required(), "replayed video file")
+        ("ground-truth", po::value<std::string>(&groundTruth), "ground truth boxes, one face per line: frame x y width height")
+        ("backends", po::value<std::string>(&backendList)->default_value("caffe,haar,lbp"), "comma separated backends to compare")
+        ("onnx-model", po::value<std::string>(&onnxModel), "model used by the onnx backend")
+        ("frames", po::value<int>(&maxFrames)->default_value(300), "number of frames to replay")
+        ("input-size", po::value<int>(&inputSize)->default_value(300), "detector input size");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    //frames are decoded up front so decoding doesn't count into detection time
+    std::vector<cv::Mat> frames;
+    cv::VideoCapture capture(video);
+    cv::Mat frame;
+    while ((int)frames.size() < maxFrames && capture.read(frame))
+        frames.push_back(frame.clone());
+    if (frames.empty()) {
+        std::cerr << "Error: could not read frames from " << video << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> backends;
+    std::istringstream is(backendList);
+    std::string backend;
+    while (std::getline(is, backend, ','))
+        backends.push_back(backend);
+
+    //reference boxes of every frame
+    std::vector<std::vector<cv::Rect>> reference(frames.size());
+    if (!groundTruth.empty()) {
+        FrameBoxes boxes = load_ground_truth(groundTruth);
+        for (size_t i = 0; i < frames.size(); ++i)
+            reference[i] = boxes[i];
+        std::cout << "recall measured against ground truth " << groundTruth << std::endl;
+    } else {
+        std::unique_ptr<FaceDetector> detector = make_face_detector(DetectorConfig());
+        BackendResult ignored;
+        reference = detect_all(*detector, frames, ignored);
+        std::cout << "no ground truth, recall measured against the caffe backend" << std::endl;
+    }
+
+    std::cout << frames.size() << " frames " << frames[0].cols << "x" << frames[0].rows << ", input size " << inputSize << std::endl;
+    std::cout << "backend\tmean_ms\tp50_ms\tp95_ms\tfps\trecall\tprecision" << std::endl;
+
+    for (const auto &name : backends) {
+        DetectorConfig config;
+        config.backend = name;
+        if (name == "onnx")
+            config.model = onnxModel;
+        std::unique_ptr<FaceDetector> detector = make_face_detector(config);
+        if (!detector || !detector->loaded()) {
+            std::cout << name << "\tnot available" << std::endl;
+            continue;
+        }
+        detector->set_input_size(inputSize);
+
+        BackendResult result;
+        std::vector<std::vector<cv::Rect>> detections = detect_all(*detector, frames, result);
+        for (size_t i = 0; i < frames.size(); ++i) {
+            result.reference_faces += reference[i].size();
+            result.detected_faces += detections[i].size();
+            result.matched_faces += matched_count(reference[i], detections[i]);
+        }
+
+        std::vector<double> sorted = result.latencies;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double l : sorted)
+            total += l;
+
+        std::cout << name << "\t" << total / sorted.size() << "\t" << sorted[sorted.size() / 2] << "\t"
+                  << sorted[sorted.size() * 95 / 100] << "\t" << 1000.0 * sorted.size() / total << "\t"
+                  << (result.reference_faces ? (double)result.matched_faces / result.reference_faces : 1.0) << "\t"
+                  << (result.detected_faces ? (double)result.matched_faces / result.detected_faces : 1.0) << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,350 @@
+// Quality-vs-cost evaluation of detector configurations on a labeled video. Every frame is replayed through the path
+// it takes in B and C: optionally in a native pixel format (scaled and converted to BGR at the detector input size),
+// detected by FaceDetector (every Nth frame, the faces are reused in between), the faces scaled to the frame as C does
+// it and censured by BlurDrawer. The censored boxes are compared with the ground truth (see evaluation.hpp), so for
+// every configuration the report gives the per-frame recall of the censored face area, the face pixels left
+// uncensored (leaked) and the compute cost per frame, and marks the configurations on the Pareto front of cost and
+// leaked pixels -- the ones worth considering for production.
+// usage: evaluate.out --video file --ground-truth file [--configuration "options"]... [--configurations file]
+//                     [--frames n] [--out file.csv] [--per-frame file.csv]
+// A configuration consists of detector options as on the command line of B plus --input-size, --every, --pixel-format,
+// --censure-mode and --motion-gating, e.g. "--detector haar --input-size 224 --every 2". Configurations are read from the command line
+// and from the file, one per line (lines starting with # are skipped); without any the defaults of B are evaluated.
+
+#include "FaceDetector.hpp"
+#include "detector_options.hpp"
+#include "BlurDrawer.hpp"
+#include "FrameFormat.hpp"
+#include "FramePublisher.hpp"
+#include "PixelFormat.hpp"
+#include "evaluation.hpp"
+#include "precision_check.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct Configuration {
+    std::string text;
+    DetectorConfig detector;
+    InferenceMode mode;
+    int input_size = 300;
+    //detection runs on every Nth frame, the frames in between are censured with the last faces
+    int every = 1;
+    std::string pixel_format = "bgr";
+    int censure_mode = 0;
+    //faces are reused while at most this share of tiles changed since the last detection (as B --motion-gating)
+    double motion_gating = -1;
+};
+
+struct FrameResult {
+    CensureCoverage coverage;
+    bool detected = false;
+    double prepare_ms = 0.0;
+    double detect_ms = 0.0;
+    double censure_ms = 0.0;
+
+    double cost_ms() const { return prepare_ms + detect_ms + censure_ms; }
+};
+
+struct Summary {
+    std::string configuration;
+    bool available = false;
+    int frames = 0;
+    int inferences = 0;
+    double prepare_ms = 0.0;
+    double detect_ms = 0.0;
+    double censure_ms = 0.0;
+    double cost_ms = 0.0;
+    double p95_cost_ms = 0.0;
+    double area_recall = 1.0;       // censored face pixels of all frames
+    double mean_frame_recall = 1.0; // average over frames with faces
+    double min_frame_recall = 1.0;
+    int leak_frames = 0;            // frames with at least one face pixel left uncensored
+    int64_t leaked_pixels = 0;
+    double over_censored = 0.0;     // share of the frame censored outside faces, on average
+    bool pareto = false;
+};
+
+
+bool parse_configuration(const std::string &text, Configuration &configuration) {
+    namespace po = boost::program_options;
+    configuration.text = text.empty() ? "(defaults of B)" : text;
+    po::options_description options;
+    add_detector_options(options, configuration.detector, configuration.mode);
+    options.add_options()
+        ("input-size", po::value<int>(&configuration.input_size)->default_value(configuration.input_size), "detector input size")
+        ("every", po::value<int>(&configuration.every)->default_value(configuration.every), "detect every Nth frame")
+        ("pixel-format", po::value<std::string>(&configuration.pixel_format)->default_value(configuration.pixel_format), "bgr, yuyv or nv12")
+        ("censure-mode", po::value<int>(&configuration.censure_mode)->default_value(configuration.censure_mode), "0 fills faces, 1 blurs them")
+        ("motion-gating", po::value<double>(&configuration.motion_gating)->default_value(configuration.motion_gating), "share of changed tiles up to which faces are reused");
+    try {
+        po::variables_map vm;
+        po::store(po::command_line_parser(po::split_unix(text)).options(options).run(), vm);
+        po::notify(vm);
+    } catch (const po::error &e) {
+        std::cerr << "Error: invalid configuration \"" << text << "\": " << e.what() << std::endl;
+        return false;
+    }
+    if (configuration.every < 1 || (configuration.pixel_format != "bgr" && native_formats(configuration.pixel_format).size() != 1)) {
+        std::cerr << "Error: invalid configuration \"" << text << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<FrameResult> replay(const Configuration &configuration, const std::vector<cv::Mat> &frames,
+                                const std::vector<std::vector<cv::Rect>> &truth, bool &available) {
+    std::vector<FrameResult> results;
+    std::unique_ptr<FaceDetector> detector = make_face_detector(configuration.detector);
+    available = detector && detector->loaded();
+    if (!available)
+        return results;
+    //int8 with --quantize is calibrated on the first replayed frames, like B calibrates on the first frames of its reference clip
+    std::vector<cv::Mat> calibration;
+    if (configuration.mode.precision == "int8" && configuration.mode.quantize)
+        calibration.assign(frames.begin(), frames.begin() + std::min<size_t>(100, frames.size()));
+    detector->set_inference_mode(configuration.mode, calibration);
+    detector->set_input_size(configuration.input_size);
+
+    //native frames are prepared up front, the camera delivers them like that
+    int pixelFormat = configuration.pixel_format == "bgr" ? PIXEL_BGR : native_formats(configuration.pixel_format)[0];
+    std::vector<cv::Mat> published;
+    for (const auto &frame : frames) {
+        cv::Mat native;
+        bgr_to_native(frame, pixelFormat, native);
+        published.push_back(native);
+    }
+
+    BlurDrawer drawer;
+    drawer.set_mode(configuration.censure_mode);
+    //warm up, the first forward pass allocates the network
+    detector->detected_face(frames[0]);
+
+    std::vector<cv::Rect> faces;
+    cv::Size facesSize = frames[0].size();
+    //frame the faces were last detected in, the tiles changed since then gate the detection like in B
+    int lastDetected = -1;
+    uint64_t dirty[FRAME_TILE_WORDS];
+    for (size_t i = 0; i < frames.size(); ++i) {
+        const cv::Mat &frame = published[i];
+        const cv::Size size = frames[i].size();
+        FrameResult result;
+
+        //B: native frames are scaled in YUV and converted to BGR at the size the detector works at
+        bool gated = false;
+        if (configuration.motion_gating >= 0 && lastDetected >= 0) {
+            TileGrid grid(frame.rows, frame.cols);
+            gated = (double)compare_tiles(frame, published[lastDetected], grid, dirty) / grid.count() <= configuration.motion_gating;
+        }
+        if (i % configuration.every == 0 && !gated) {
+            auto start = std::chrono::steady_clock::now();
+            cv::Mat image = frame;
+            if (pixelFormat != PIXEL_BGR)
+                scaled_bgr(frame, pixelFormat, detector->detection_size(size), image);
+            auto prepared = std::chrono::steady_clock::now();
+            faces = faces_to_rects(detector->detected_face(image));
+            facesSize = image.size();
+            result.detected = true;
+            lastDetected = i;
+            result.prepare_ms = std::chrono::duration<double, std::milli>(prepared - start).count();
+            result.detect_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepared).count();
+        }
+
+        //C: faces scaled to the frame, the frame copied (or converted) and censured
+        auto start = std::chrono::steady_clock::now();
+        std::vector<cv::Rect> censored;
+        for (const auto &face : faces)
+            censored.push_back(scaled_face(face, (double)size.width / facesSize.width, (double)size.height / facesSize.height, size));
+        drawer.set_draw_info(frame, censored, pixelFormat);
+        drawer.draw();
+        result.censure_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        result.coverage = censure_coverage(truth[i], censored, size);
+        results.push_back(result);
+    }
+    return results;
+}
+
+Summary summarize(const std::string &configuration, const std::vector<FrameResult> &results, const cv::Size &frame) {
+    Summary summary;
+    summary.configuration = configuration;
+    summary.available = !results.empty();
+    if (results.empty())
+        return summary;
+
+    std::vector<double> costs;
+    int64_t facePixels = 0, censoredFacePixels = 0;
+    double recallSum = 0.0, overSum = 0.0;
+    int framesWithFaces = 0;
+    for (const auto &r : results) {
+        summary.inferences += r.detected;
+        summary.prepare_ms += r.prepare_ms;
+        summary.detect_ms += r.detect_ms;
+        summary.censure_ms += r.censure_ms;
+        costs.push_back(r.cost_ms());
+        facePixels += r.coverage.face_pixels;
+        censoredFacePixels += r.coverage.censored_face_pixels;
+        summary.leaked_pixels += r.coverage.leaked();
+        summary.leak_frames += r.coverage.leaked() > 0;
+        overSum += (double)r.coverage.over_pixels / frame.area();
+        if (r.coverage.face_pixels > 0) {
+            double recall = (double)r.coverage.censored_face_pixels / r.coverage.face_pixels;
+            recallSum += recall;
+            summary.min_frame_recall = std::min(summary.min_frame_recall, recall);
+            ++framesWithFaces;
+        }
+    }
+    summary.frames = results.size();
+    summary.prepare_ms /= summary.frames;
+    summary.detect_ms /= summary.frames;
+    summary.censure_ms /= summary.frames;
+    summary.cost_ms = summary.prepare_ms + summary.detect_ms + summary.censure_ms;
+    std::sort(costs.begin(), costs.end());
+    summary.p95_cost_ms = costs[costs.size() * 95 / 100];
+    if (facePixels > 0)
+        summary.area_recall = (double)censoredFacePixels / facePixels;
+    if (framesWithFaces > 0)
+        summary.mean_frame_recall = recallSum / framesWithFaces;
+    summary.over_censored = overSum / summary.frames;
+    return summary;
+}
+
+//a configuration is on the Pareto front when no other one is at most as expensive and leaks at most as many pixels,
+//being better in one of them
+void mark_pareto(std::vector<Summary> &summaries) {
+    for (auto &s : summaries) {
+        s.pareto = s.available;
+        for (const auto &other : summaries)
+            if (other.available && other.cost_ms <= s.cost_ms && other.leaked_pixels <= s.leaked_pixels
+                && (other.cost_ms < s.cost_ms || other.leaked_pixels < s.leaked_pixels))
+                s.pareto = false;
+    }
+}
+
+void print_summary(std::ostream &out, const Summary &s, const std::string &separator) {
+    out << (separator == "," ? "\"" + s.configuration + "\"" : s.configuration) << separator;
+    if (!s.available) {
+        out << "not available" << std::endl;
+        return;
+    }
+    out << s.cost_ms << separator << s.p95_cost_ms << separator << s.prepare_ms << separator << s.detect_ms << separator
+        << s.censure_ms << separator << s.inferences << separator << s.area_recall << separator << s.mean_frame_recall
+        << separator << s.min_frame_recall << separator << s.leak_frames << separator << (double)s.leaked_pixels / s.frames
+        << separator << s.over_censored << separator << (s.pareto ? "*" : "") << std::endl;
+}
+
+const char *SUMMARY_COLUMNS[] = {"configuration", "cost_ms", "p95_cost_ms", "prepare_ms", "detect_ms", "censure_ms",
+                                 "inferences", "area_recall", "mean_frame_recall", "min_frame_recall", "leak_frames",
+                                 "leaked_px_per_frame", "over_censored", "pareto"};
+
+void print_header(std::ostream &out, const std::string &separator) {
+    for (size_t i = 0; i < sizeof(SUMMARY_COLUMNS) / sizeof(SUMMARY_COLUMNS[0]); ++i)
+        out << (i > 0 ? separator : "") << SUMMARY_COLUMNS[i];
+    out << std::endl;
+}
+
+
+int main(int argc, char **argv) {
+    std::string video, groundTruth, configurationFile, outFile, perFrameFile;
+    std::vector<std::string> configurationTexts;
+    int maxFrames;
+
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("video", po::value<std::string>(&video)->required(), "replayed video file")
+        ("ground-truth", po::value<std::string>(&groundTruth)->required(), "face boxes, one per line: frame x y width height")
+        ("configuration", po::value<std::vector<std::string>>(&configurationTexts), "evaluated configuration, can be repeated")
+        ("configurations", po::value<std::string>(&configurationFile), "file with one configuration per line")
+        ("frames", po::value<int>(&maxFrames)->default_value(300), "number of frames to replay")
+        ("out", po::value<std::string>(&outFile), "CSV file with the summary of every configuration")
+        ("per-frame", po::value<std::string>(&perFrameFile), "CSV file with the results of every frame");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+
+    if (!configurationFile.empty()) {
+        std::ifstream file(configurationFile);
+        std::string line;
+        while (std::getline(file, line))
+            if (!line.empty() && line[0] != '#')
+                configurationTexts.push_back(line);
+    }
+    if (configurationTexts.empty())
+        configurationTexts.push_back("");
+
+    //frames are decoded up front so decoding doesn't count into the cost; native formats need even frame sizes
+    std::vector<cv::Mat> frames = read_clip(video, maxFrames);
+    if (frames.empty()) {
+        std::cerr << "Error: could not read frames from " << video << std::endl;
+        return 1;
+    }
+    cv::Size size(frames[0].cols & ~1, frames[0].rows & ~1);
+    for (auto &frame : frames)
+        frame = frame(cv::Rect(cv::Point(0, 0), size)).clone();
+
+    FrameBoxes boxes = load_ground_truth(groundTruth);
+    std::vector<std::vector<cv::Rect>> truth(frames.size());
+    for (size_t i = 0; i < frames.size(); ++i)
+        truth[i] = boxes[i];
+    std::cout << frames.size() << " frames " << size.width << "x" << size.height << ", ground truth " << groundTruth << std::endl;
+
+    std::ofstream perFrame;
+    if (!perFrameFile.empty()) {
+        perFrame.open(perFrameFile);
+        perFrame << "configuration,frame,detected,face_pixels,censored_face_pixels,leaked_pixels,over_pixels,cost_ms" << std::endl;
+    }
+
+    std::vector<Summary> summaries;
+    for (const auto &text : configurationTexts) {
+        Configuration configuration;
+        if (!parse_configuration(text, configuration))
+            continue;
+        std::cout << "Evaluating " << configuration.text << std::endl;
+        bool available = false;
+        std::vector<FrameResult> results = replay(configuration, frames, truth, available);
+        summaries.push_back(summarize(configuration.text, results, size));
+        for (size_t i = 0; perFrame.is_open() && i < results.size(); ++i) {
+            const FrameResult &r = results[i];
+            perFrame << "\"" << configuration.text << "\"," << i << "," << r.detected << "," << r.coverage.face_pixels << ","
+                     << r.coverage.censored_face_pixels << "," << r.coverage.leaked() << "," << r.coverage.over_pixels << ","
+                     << r.cost_ms() << std::endl;
+        }
+    }
+    mark_pareto(summaries);
+
+    print_header(std::cout, "\t");
+    for (const auto &s : summaries)
+        print_summary(std::cout, s, "\t");
+
+    //the front ordered by cost: every next configuration leaks less at a higher cost
+    std::vector<Summary> front;
+    for (const auto &s : summaries)
+        if (s.pareto)
+            front.push_back(s);
+    std::sort(front.begin(), front.end(), [](const Summary &a, const Summary &b) { return a.cost_ms < b.cost_ms; });
+    std::cout << std::endl << "Pareto front (cost per frame vs leaked face pixels):" << std::endl;
+    for (const auto &s : front)
+        std::cout << "\t" << s.cost_ms << " ms\t" << (double)s.leaked_pixels / s.frames << " px leaked per frame\trecall "
+                  << s.area_recall << "\t" << s.configuration << std::endl;
+
+    if (!outFile.empty()) {
+        std::ofstream out(outFile);
+        print_header(out, ",");
+        for (const auto &s : summaries)
+            print_summary(out, s, ",");
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Bandwidth of the frame buffers shared by A, B and C with different page sizes and NUMA placements.
+// For 1080p and 4K frames it measures the full-frame memcpy done by A (write) and a sequential pass over the
+// frame like the reads of B and C (read), with buffers on small pages, transparent huge pages and hugetlbfs
+// (when huge pages are reserved, e.g. sysctl vm.nr_hugepages=64). On NUMA machines the benchmark runs on the CPUs
+// of node 0 and the buffer is placed on every node, so local and remote placement can be compared.
+// usage: hugepage_bench.out [iterations]
+
+#include "ipc.hpp"
+#include "FrameBuffer.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+
+#define BENCH_BUFFER_NAME "hugepage_bench_buffer"
+
+using namespace boost::interprocess;
+
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+struct Bandwidth {
+    double write_gbps;
+    double read_gbps;
+};
+
+Bandwidth measure(FrameBuffer &buffer, size_t bytes, int iterations) {
+    std::vector<unsigned char> frame(bytes, 7);
+
+    //first pass maps all pages
+    memcpy(buffer.get_address(), frame.data(), bytes);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        frame[i % bytes] = i;
+        memcpy(buffer.get_address(), frame.data(), bytes);
+    }
+    double write = seconds_since(start);
+
+    const uint64_t *words = static_cast<const uint64_t*>(buffer.get_address());
+    volatile uint64_t sink = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t sum = 0;
+        for (size_t w = 0; w < bytes / sizeof(uint64_t); ++w)
+            sum += words[w];
+        sink = sink + sum;
+    }
+    double read = seconds_since(start);
+
+    double gigabytes = (double)bytes * iterations / 1e9;
+    return Bandwidth{gigabytes / write, gigabytes / read};
+}
+
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 50;
+
+    struct FrameSize { const char *name; size_t bytes; };
+    std::vector<FrameSize> sizes = {{"1080p", 1920 * 1080 * 3}, {"4K", 3840 * 2160 * 3}};
+    std::vector<FramePages> modes = {PAGES_SMALL, PAGES_TRANSPARENT, PAGES_AUTO};
+
+    //run on node 0 and place the buffer on each node, -1 leaves the placement to the first touch
+    std::map<int, int> nodes = cpu_nodes();
+    std::vector<int> placements = {-1};
+    int nOfNodes = 0;
+    for (const auto &cpu : nodes)
+        nOfNodes = std::max(nOfNodes, cpu.second + 1);
+    if (nOfNodes > 1) {
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        for (const auto &cpu : nodes)
+            if (cpu.second == 0)
+                CPU_SET(cpu.first, &mask);
+        sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+        placements.clear();
+        for (int node = 0; node < nOfNodes; ++node)
+            placements.push_back(node);
+    }
+
+    std::cout << iterations << " iterations, " << nOfNodes << " NUMA nodes, huge page size " << huge_page_size() / 1024 << " KB" << std::endl;
+    std::cout << "frame\tpages\tnode\twrite_GB/s\tread_GB/s" << std::endl;
+
+    for (const auto &size : sizes) {
+        for (FramePages mode : modes) {
+            for (int node : placements) {
+                IpcRemover<FrameBuffer> remover(BENCH_BUFFER_NAME);
+                std::unique_ptr<FrameBuffer> buffer;
+                try {
+                    buffer.reset(new FrameBuffer(create_only, BENCH_BUFFER_NAME, size.bytes, node, mode));
+                } catch (const interprocess_exception &e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    continue;
+                }
+                //without reserved huge pages the automatic choice is the same as transparent huge pages
+                if (mode == PAGES_AUTO && buffer->page_kind() != "hugetlbfs") {
+                    std::cout << size.name << "\thugetlbfs\t-\tnot available" << std::endl;
+                    break;
+                }
+                Bandwidth bandwidth = measure(*buffer, size.bytes, iterations);
+                std::cout << size.name << "\t" << buffer->page_kind() << "\t" << (node < 0 ? std::string("local") : std::to_string(node))
+                          << "\t" << bandwidth.write_gbps << "\t" << bandwidth.read_gbps << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Stress test of the shared frame lock under mixed scheduling policies, the classic priority inversion setup:
+// all processes share one CPU, a SCHED_OTHER holder (like A) copies a full HD frame under the lock, a SCHED_FIFO 40
+// process burns CPU in bursts and a SCHED_FIFO 60 waiter (like C under a real-time policy) measures how long it
+// waits for the lock. Without priority inheritance the holder is preempted by the busy process while the waiter
+// is blocked, with RobustMutex it runs at the priority of the waiter until it unlocks.
+// Finally a process dies holding the lock to check the owner death recovery.
+// usage: sudo lock_stress.out [seconds per mutex] [cpu]
+
+#include "ipc.hpp"
+#include "RobustMutex.hpp"
+
+#include <boost/interprocess/sync/named_mutex.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define STRESS_MUTEX_NAME "lock_stress_mutex"
+#define FRAME_BYTES (1920 * 1080 * 3)
+
+using namespace boost::interprocess;
+
+
+double now_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//pin the calling process to the cpu and set its policy, false when it's not permitted
+bool setup_process(int cpu, int policy, int priority) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    sched_setaffinity(0, sizeof(cpu_set_t), &mask);
+    sched_param parameter;
+    parameter.sched_priority = priority;
+    return sched_setscheduler(0, policy, &parameter) == 0;
+}
+
+//SCHED_FIFO 40, busy for 20 ms then sleeping for 10 ms, so the machine stays usable
+void busy_process(int cpu) {
+    setup_process(cpu, SCHED_FIFO, 40);
+    while (true) {
+        double start = now_ms();
+        while (now_ms() - start < 20.0)
+            ;
+        usleep(10000);
+    }
+}
+
+//SCHED_OTHER, copies a frame under the lock like A does
+template <class Mutex>
+void holder_process(int cpu) {
+    setup_process(cpu, SCHED_OTHER, 0);
+    Mutex mutex(open_only, STRESS_MUTEX_NAME);
+    std::vector<unsigned char> source(FRAME_BYTES, 1), frame(FRAME_BYTES);
+    while (true) {
+        mutex.lock();
+        memcpy(frame.data(), source.data(), FRAME_BYTES);
+        mutex.unlock();
+        usleep(1000);
+    }
+}
+
+pid_t start(void (*process)(int), int cpu) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        process(cpu);
+        exit(0);
+    }
+    return pid;
+}
+
+template <class Mutex>
+void run(const std::string &name, int seconds, int cpu) {
+    IpcRemover<Mutex> remover(STRESS_MUTEX_NAME);
+    Mutex mutex(create_only, STRESS_MUTEX_NAME);
+
+    pid_t holder = start(holder_process<Mutex>, cpu);
+    pid_t busy = start(busy_process, cpu);
+    bool realtime = setup_process(cpu, SCHED_FIFO, 60);
+
+    std::vector<double> waits;
+    double end = now_ms() + seconds * 1000.0;
+    while (now_ms() < end) {
+        double start = now_ms();
+        mutex.lock();
+        waits.push_back(now_ms() - start);
+        mutex.unlock();
+        usleep(2000);
+    }
+
+    kill(holder, SIGKILL);
+    kill(busy, SIGKILL);
+    waitpid(holder, NULL, 0);
+    waitpid(busy, NULL, 0);
+    setup_process(cpu, SCHED_OTHER, 0);
+
+    std::sort(waits.begin(), waits.end());
+    double sum = 0.0;
+    for (double w : waits)
+        sum += w;
+    std::cout << name << "\t" << waits.size() << "\t" << sum / waits.size() << "\t"
+              << waits[(size_t)(0.99 * (waits.size() - 1))] << "\t" << waits.back()
+              << (realtime ? "" : "\t(no real-time policies, run with sudo)") << std::endl;
+}
+
+//a process locks the mutex and dies, the next lock has to recover it
+void owner_death() {
+    IpcRemover<RobustMutex> remover(STRESS_MUTEX_NAME);
+    RobustMutex mutex(create_only, STRESS_MUTEX_NAME);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        RobustMutex child(open_only, STRESS_MUTEX_NAME);
+        child.lock();
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+
+    double start = now_ms();
+    mutex.lock();
+    double recovery = now_ms() - start;
+    mutex.unlock();
+    //after recovery the mutex has to work as usual
+    bool usable = mutex.try_lock();
+    if (usable)
+        mutex.unlock();
+    std::cout << "owner death: recovered in " << recovery << " ms, " << (usable ? "mutex usable afterwards" : "mutex NOT usable") << std::endl;
+}
+
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 5;
+    int cpu = argc > 2 ? atoi(argv[2]) : 0;
+
+    std::cout << "all processes on cpu " << cpu << ", " << seconds << " s per mutex, lock waits in ms" << std::endl;
+    std::cout << "mutex\tlocks\tmean\tp99\tmax" << std::endl;
+    run<named_mutex>("named_mutex", seconds, cpu);
+    run<RobustMutex>("RobustMutex", seconds, cpu);
+    owner_death();
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Scaling benchmark of the batched detection done by process B.
+// For 1 to 16 synthetic streams it compares detecting the frame of every stream separately with a single batched
+// forward pass, and shows how the fair scheduler sheds load once a round no longer fits into INFERENCE_BUDGET_MS.
+// usage: streams_bench.out [rounds per stream count] [frame width] [frame height]
+
+#include "names.hpp"
+#include "FaceDetector.hpp"
+#include "StreamScheduler.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+//noise with a few bright blobs, detection cost doesn't depend on the content
+cv::Mat synthetic_frame(int width, int height, int seed) {
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    for (int i = 0; i < 3; ++i) {
+        cv::Point center((seed * 97 + i * 151) % width, (seed * 53 + i * 89) % height);
+        cv::circle(frame, center, 40 + 10 * i, cv::Scalar(200, 180, 160), -1);
+    }
+    return frame;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 20;
+    int width = argc > 2 ? atoi(argv[2]) : 640;
+    int height = argc > 3 ? atoi(argv[3]) : 480;
+
+    std::unique_ptr<FaceDetector> detector = make_face_detector(DetectorConfig());
+    FaceDetector & face_detector = *detector;
+
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < MAX_STREAMS; ++i)
+        frames.push_back(synthetic_frame(width, height, i));
+
+    std::cout << "frames " << width << "x" << height << ", " << rounds << " rounds, inference budget " << INFERENCE_BUDGET_MS << " ms" << std::endl;
+    std::cout << "streams\tsequential_ms\tbatched_ms\tspeedup\tscheduled_ms\tframes_per_round\tshed_%\tmin_served\tmax_served" << std::endl;
+
+    for (int n = 1; n <= MAX_STREAMS; ++n) {
+        std::vector<cv::Mat> streams(frames.begin(), frames.begin() + n);
+
+        //warm up the network for this batch size
+        face_detector.detected_faces(streams);
+
+        //every stream detected on its own
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+            for (const auto &frame : streams)
+                face_detector.detected_face(frame);
+        double sequential = elapsed_ms(start) / rounds;
+
+        //all streams in one forward pass
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r)
+            face_detector.detected_faces(streams);
+        double batched = elapsed_ms(start) / rounds;
+
+        //batches chosen by the scheduler, as in process B
+        StreamScheduler scheduler(n, INFERENCE_BUDGET_MS);
+        long frames_done = 0;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; ++r) {
+            std::vector<int> batch = scheduler.next_batch();
+            std::vector<cv::Mat> images;
+            for (int s : batch)
+                images.push_back(streams[s]);
+
+            auto batch_start = std::chrono::steady_clock::now();
+            face_detector.detected_faces(images);
+            scheduler.batch_done(batch.size(), elapsed_ms(batch_start));
+            frames_done += batch.size();
+        }
+        double scheduled = elapsed_ms(start) / rounds;
+
+        long min_served = scheduler.served_count(0), max_served = scheduler.served_count(0);
+        for (int s = 1; s < n; ++s) {
+            min_served = std::min(min_served, scheduler.served_count(s));
+            max_served = std::max(max_served, scheduler.served_count(s));
+        }
+
+        std::cout << n << "\t" << sequential << "\t" << batched << "\t" << sequential / batched << "\t"
+                  << scheduled << "\t" << (double)frames_done / rounds << "\t"
+                  << 100.0 * (1.0 - (double)frames_done / (rounds * n)) << "\t"
+                  << min_served << "\t" << max_served << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Latency of the detection and censure work of B and C on constrained core sets.
+// For 1, 2, half and all of the online CPUs the process is pinned to the core set and a frame is detected and
+// its faces blurred, first with the OpenCV thread pool sized to all online CPUs (as before ThreadBudget) and then
+// with the pool sized by ThreadBudget to the physical cores of the set.
+// usage: thread_budget_bench.out [frames per run] [frame width] [frame height]
+
+#include "names.hpp"
+#include "FaceDetector.hpp"
+#include "ThreadBudget.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include <sched.h>
+#include <unistd.h>
+
+
+struct RunTimes {
+    double mean_ms;
+    double p99_ms;
+};
+
+//detect faces and blur a few regions of the frame, as B and C do for every frame
+RunTimes run(FaceDetector &detector, const cv::Mat &frame, int frames) {
+    std::vector<double> times;
+    cv::Mat censured;
+    for (int f = 0; f < frames; ++f) {
+        auto start = std::chrono::steady_clock::now();
+        detector.detected_face(frame);
+        frame.copyTo(censured);
+        for (int i = 0; i < 4; ++i) {
+            cv::Rect region(i * frame.cols / 4, frame.rows / 4, frame.cols / 4, frame.rows / 2);
+            cv::Mat roi = censured(region);
+            cv::GaussianBlur(roi, roi, cv::Size(51, 51), 0);
+        }
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    double sum = 0.0;
+    for (double t : times)
+        sum += t;
+    return RunTimes{sum / times.size(), times[std::min(times.size() - 1, (size_t)(0.99 * times.size()))]};
+}
+
+bool pin(const std::vector<int> &cpus) {
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : cpus)
+        CPU_SET(cpu, &mask);
+    return sched_setaffinity(0, sizeof(cpu_set_t), &mask) == 0;
+}
+
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 100;
+    int width = argc > 2 ? atoi(argv[2]) : 640;
+    int height = argc > 3 ? atoi(argv[3]) : 480;
+
+    std::unique_ptr<FaceDetector> detector = make_face_detector(DetectorConfig());
+    cv::Mat frame(height, width, CV_8UC3);
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    //the core sets are taken from the CPUs the benchmark was started on
+    std::vector<int> cpus = allowed_cpus();
+    int online = sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<size_t> setSizes = {1, 2, cpus.size() / 2, cpus.size()};
+    std::sort(setSizes.begin(), setSizes.end());
+    setSizes.erase(std::unique(setSizes.begin(), setSizes.end()), setSizes.end());
+
+    std::cout << "frames " << width << "x" << height << ", " << frames << " frames per run, " << online << " online CPUs" << std::endl;
+    std::cout << "cpus\tcores\tthreads_before\tmean_ms\tp99_ms\tthreads_after\tmean_ms\tp99_ms" << std::endl;
+
+    for (size_t n : setSizes) {
+        if (n == 0 || n > cpus.size())
+            continue;
+        std::vector<int> set(cpus.begin(), cpus.begin() + n);
+        if (!pin(set)) {
+            std::cerr << "Error: could not pin to " << n << " CPUs" << std::endl;
+            continue;
+        }
+        CpuTopology topology = topology_of(set);
+
+        //thread per online CPU, the pool is recreated so its threads inherit the new mask
+        cv::setNumThreads(online);
+        run(*detector, frame, 5);
+        RunTimes before = run(*detector, frame, frames);
+
+        int budget = thread_budget(topology);
+        cv::setNumThreads(budget);
+        run(*detector, frame, 5);
+        RunTimes after = run(*detector, frame, frames);
+
+        std::cout << topology.cpus << "\t" << topology.cores << "\t" << online << "\t" << before.mean_ms << "\t" << before.p99_ms
+                  << "\t" << budget << "\t" << after.mean_ms << "\t" << after.p99_ms << std::endl;
+    }
+
+    return 0;
+}
@@ -1,5 +1,6 @@
-// This process is responsible for receiving video from the camera, extracting separate frames from it,
-// and forwarding them at a capped rate to processes B and C.
+// This process is responsible for receiving video from the cameras (or video files given as arguments),
+// extracting separate frames from them, and forwarding them at a capped rate to processes B and C.
+// Every source is a separate stream with its own IPC objects and capture thread.
 // This process can receive requests to change the sending rate from process D, which is responsible for the UI.
 
 // #include <opencv4/opencv2/opencv.hpp>
@@ -12,19 +13,34 @@
 
 
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <vector>
 #include <sys/times.h>
 #include <signal.h>
 
 #include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/sync/named_mutex.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
 
 #include "names.hpp"
+#include "ipc.hpp"
+#include "RobustMutex.hpp"
+#include "FrameBuffer.hpp"
+#include "FrameFormat.hpp"
+#include "FramePublisher.hpp"
+#include "StageQueue.hpp"
+#include "stats.hpp"
+#include "ThreadBudget.hpp"
+#include "realtime.hpp"
+#include "PerfCounters.hpp"
+#include "SyntheticCapture.hpp"
+#include "soak.hpp"
 
 
 using namespace boost::interprocess;
@@ -50,11 +66,15 @@ void handleSIGINT(int sig)
 class FrameSender{
 private:
 
-    // upper fps limit
+    // upper fps limit set by the user
     int _fps;
-    // 1/fps -- the minimal time (minus a delta to make the limit less strict) between consecutive frame sendings
+    // rate actually used, chosen by the rate controller and never above _fps
+    double _rate;
+    // 1/rate -- the minimal time (minus a delta to make the limit less strict) between consecutive frame sendings
     std::chrono::duration<double> _frameTime;
-    // used for synchronization with the thread responsible for receiving new fps limit values from the UI 
+    // end-to-end latency the rate controller aims for
+    double _latencySlo;
+    // used for synchronization with the threads responsible for receiving new fps limit and latency target values from the UI
     std::mutex _fpsMutex;
 
     
@@ -63,6 +83,7 @@ public:
     static const int DEFAULT_FPS = 30;
 
     FrameSender(){
+        _latencySlo = DEFAULT_LATENCY_SLO_MS;
         setFrameTime(DEFAULT_FPS);
     }
 
@@ -78,10 +99,26 @@ public:
         std::cout << "Changing fps to: " << fps << std::endl;
         _fpsMutex.lock();
         _fps = fps;
-        _frameTime = std::chrono::duration<double>(1.0/_fps);
+        _rate = _fps;
+        _frameTime = std::chrono::duration<double>(1.0/_rate);
         _fpsMutex.unlock();
     }
 
+    //used by the rate controller, the rate is capped by the fps limit set by the user
+    void setRate(double rate){
+        _fpsMutex.lock();
+        _rate = std::min(rate, (double)_fps);
+        _frameTime = std::chrono::duration<double>(1.0/_rate);
+        _fpsMutex.unlock();
+    }
+
+    double getRate(){
+        _fpsMutex.lock();
+        double rate = _rate;
+        _fpsMutex.unlock();
+        return rate;
+    }
+
     int getFps(){
         _fpsMutex.lock();
         int fps = _fps;
@@ -89,11 +126,65 @@ public:
         return fps;
     }
 
+    void setLatencySlo(double slo){
+        std::cout << "Changing latency target to: " << slo << " ms" << std::endl;
+        _fpsMutex.lock();
+        _latencySlo = slo;
+        _fpsMutex.unlock();
+    }
+
+    double getLatencySlo(){
+        _fpsMutex.lock();
+        double slo = _latencySlo;
+        _fpsMutex.unlock();
+        return slo;
+    }
+
+};
+
+// Feedback controller of the sending rate (additive increase, multiplicative decrease).
+// The rate can never exceed what the slowest of B (inference) and C (censure and display) can handle, since frames
+// sent faster than that are only overwritten in shmem or pile up behind the detector.
+// Below that ceiling the rate is lowered whenever the measured capture-to-display latency exceeds the target
+// and slowly raised again while the latency stays within it.
+class RateController{
+private:
+    double _rate;
+
+    // the rate is never lowered below this value
+    const double MIN_FPS = 1.0;
+    // rate multiplier applied when latency is over the target
+    const double DECREASE_FACTOR = 0.8;
+    // fps added every control period when latency is within the target
+    const double INCREASE_STEP = 1.0;
+
+public:
+    explicit RateController(double initialRate) : _rate(initialRate) {}
+
+    double update(double fpsCap, double latencySloMs, double latencyMs, double inferenceMs, double renderMs){
+        double ceiling = fpsCap;
+        double stageMs = std::max(inferenceMs, renderMs);
+        if (stageMs > 0.0)
+            ceiling = std::min(ceiling, 1000.0 / stageMs);
+
+        if (stageMs >= latencySloMs)
+            // target can't be met even without queueing, so lowering the rate would only cost frames
+            _rate = ceiling;
+        else if (latencyMs > latencySloMs)
+            _rate *= DECREASE_FACTOR;
+        else
+            _rate += INCREASE_STEP;
+
+        _rate = std::max(MIN_FPS, std::min(_rate, ceiling));
+        return _rate;
+    }
+
+    double getRate() const { return _rate; }
 };
 
 // responsible for receiving information about new fps limits from the UI
 // meant to run in a helper thread, since the receive() method is a blocking operation
-void waitForFpsChange(FrameSender & s){
+void waitForFpsChange(std::vector<std::unique_ptr<FrameSender>> & senders){
 
     message_queue fps_mq
         (open_only       
@@ -106,139 +197,516 @@ void waitForFpsChange(FrameSender & s){
 
     while(true){
         fps_mq.receive(&new_fps, sizeof(new_fps), recvd_size, priority);
-        s.setFrameTime(new_fps);
+        for (auto & s : senders)
+            s->setFrameTime(new_fps);
       }
 }
 
+// responsible for receiving new end-to-end latency targets (in ms) from the UI
+void waitForSloChange(std::vector<std::unique_ptr<FrameSender>> & senders){
 
+    message_queue slo_mq
+        (open_only
+        ,SLO_Q_NAME
+        );
 
+    unsigned int priority;
+    std::size_t recvd_size;
+    int new_slo;
 
-int main(int argc, char **argv) {
-    
-    //here we define a signal handler and start CPU time tracking to display average CPU usage of the process at the exit
-    signal(SIGINT, handleSIGINT);
-    realStart = times(&cpuStart);
-
-    cv::VideoCapture capture;
-    cv::Mat frame;
-    FrameSender frameSender;
-    
+    while(true){
+        slo_mq.receive(&new_slo, sizeof(new_slo), recvd_size, priority);
+        for (auto & s : senders)
+            s->setLatencySlo(new_slo);
+      }
+}
 
-    // some cameras require a different open value, if needed, change it in names.hpp
-    if (!capture.open(CAPTURE_OPEN_VALUE))
-        capture.open(CAPTURE_OPEN_VALUE_2);
 
+// IPC objects of a single stream: the frame shmem, its mutex and the queue telling B which frames to detect, all
+// created by A
+struct StreamChannel{
 
-    // =================================
-    // INITIAL IPC OBJECTS SETUP BEGIN
+    IpcRemover<FrameBuffer> frameShmemRemover;
+    IpcRemover<RobustMutex> frameMutexRemover;
+    IpcRemover<StageQueue> queueRemover;
 
-    struct shm_remove
+    //mutex used to guard frame shared memory
+    RobustMutex mutexFrame;
+    //frame buffer backed by huge pages when possible
+    FrameBuffer frameRegion;
+    //largest frame (in bytes) the buffer can hold
+    size_t capacity;
+    //a ticket for every published frame, handled by the policy of the queue
+    StageQueue abQueue;
+
+    //the first frame of the stream is used to define shmem size, so the native resolution of the source always fits;
+    //after a restart (reattach) the objects still used by B and C are opened, otherwise they are new
+    StreamChannel(int stream, const cv::Mat & frame, int pixelFormat, const QueuePolicy & queuePolicy, bool reattach) :
+        frameShmemRemover(streamName(FRAME_SHMEM_NAME, stream), reattach),
+        frameMutexRemover(streamName(FRAME_MUTEX_NAME, stream), reattach),
+        queueRemover(streamName(AB_SYNC_Q_NAME, stream), reattach),
+        mutexFrame(open_or_create, frameMutexRemover.name.c_str()),
+        //in this shmem we will store the frame format and the timestamp of capture followed by frame data
+        frameRegion(open_or_create, frameShmemRemover.name.c_str(), sizeof(FrameSlotHeader) + frame.total() * frame.elemSize()),
+        capacity(frameRegion.get_size() - sizeof(FrameSlotHeader)),
+        abQueue(open_or_create, queueRemover.name.c_str(), queuePolicy)
     {
-        shm_remove() { shared_memory_object::remove(FRAME_SHMEM_NAME);}
-        ~shm_remove() { shared_memory_object::remove(FRAME_SHMEM_NAME);}
-    } shm_remover;
+        //B and C learn dimensions and frame type (colors palette etc.) from the format in front of the frame,
+        //a reattached buffer keeps its format, the next frame of another format gets the next version
+        mutexFrame.lock();
+        FrameSlotHeader * header = frame_header(frameRegion.get_address());
+        if (header->format.version == 0) {
+            header->format = FrameFormat::of(frame, pixelFormat, 1);
+            header->captureTime = 0;
+        }
+        mutexFrame.unlock();
+    }
+};
 
-    
-    struct shm_remove2
-    {
-        shm_remove2() { shared_memory_object::remove(FRAMESIZE_SHMEM);}
-        ~shm_remove2() { shared_memory_object::remove(FRAMESIZE_SHMEM);}
-    } shm_remover2;
+// Capture resolution requested from the UI for all streams, 0x0 means the native resolution of each source.
+// Cameras are asked for the resolution directly, frames of other sources (or cameras that don't support it) are
+// scaled by A, so lowering the resolution is also a way to shed load of B and C.
+class CaptureResolution{
+private:
+    cv::Size _size;
+    // incremented with every request, so capture threads notice a request even for the same size
+    unsigned _request;
+    std::mutex _mutex;
 
-    
-    struct mutex_remove
-    {
-        mutex_remove() { named_mutex::remove(FRAME_MUTEX_NAME); }
-        ~mutex_remove(){ named_mutex::remove(FRAME_MUTEX_NAME); }
-    } mutex_remover;
+public:
+    CaptureResolution() : _size(0, 0), _request(0) {}
+
+    void set(cv::Size size){
+        std::cout << "Changing capture resolution to: " << size.width << "x" << size.height << std::endl;
+        _mutex.lock();
+        _size = size;
+        ++_request;
+        _mutex.unlock();
+    }
 
-    struct mutex_remove2
-    {
-        mutex_remove2() { named_mutex::remove(FRAMESIZE_MUTEX); }
-        ~mutex_remove2(){ named_mutex::remove(FRAMESIZE_MUTEX); }
-    } mutex_remover2;
+    cv::Size get(unsigned & request){
+        _mutex.lock();
+        cv::Size size = _size;
+        request = _request;
+        _mutex.unlock();
+        return size;
+    }
+};
 
-    //mutex used to guard shared memory with frame size
-    named_mutex mutexFramesize(create_only, FRAMESIZE_MUTEX);
-    
-    shared_memory_object framesizeInfo(create_only, FRAMESIZE_SHMEM, read_write);
-    framesizeInfo.truncate(3*sizeof(long));
-    mapped_region framesizeRegion(framesizeInfo, read_write);
+// responsible for receiving capture resolutions (width and height) from the UI
+void waitForCaptureResolution(CaptureResolution & resolution){
 
+    message_queue resolution_mq
+        (open_only
+        ,CAPTURE_RESOLUTION_Q_NAME
+        );
 
+    unsigned int priority;
+    std::size_t recvd_size;
+    int size[2];
 
-    //read first frame to obtain information about capture, much easier than using capture.get()
-    capture >> frame;
+    while(true){
+        resolution_mq.receive(size, sizeof(size), recvd_size, priority);
+        resolution.set(cv::Size(size[0], size[1]));
+    }
+}
 
-    //use obtained info to define shmem size
-    //mutex used to guard frame shared memory
-    named_mutex mutexFrame(create_only, FRAME_MUTEX_NAME);
-    shared_memory_object frameShmem(create_only, FRAME_SHMEM_NAME, read_write);
-    //in this shmem we will store frame data + timestamp of capture thus we need additional int64_t
-    frameShmem.truncate(frame.cols * frame.rows * frame.channels() + sizeof(int64_t));
-    mapped_region frameRegion(frameShmem, read_write);
+// responsible for receiving the NUMA node of the consumers from the UI, the frame buffers are moved there
+void waitForNumaNode(std::vector<std::unique_ptr<StreamChannel>> & channels){
 
-    // INITIAL IPC OBJECTS SETUP END
-    // =================================
+    message_queue numa_mq
+        (open_only
+        ,NUMA_Q_NAME
+        );
 
-    //send dimensions and frame type (colors palette etc.) to B and C
-    mutexFramesize.lock();
-    
-    long tocopy[3] = {frame.rows, frame.cols, frame.type()};
-    memcpy(framesizeRegion.get_address(), tocopy, sizeof(tocopy));
+    unsigned int priority;
+    std::size_t recvd_size;
+    int node;
 
-    mutexFramesize.unlock();
-    
-    //start a new thread which listens to coming FPS change
-    std::thread fpsListener(waitForFpsChange, std::ref(frameSender));
-    
-    std::cout << "FPS: " << frameSender.getFps() << std::endl << "dimensions: " << frame.cols << "x" << frame.rows << std::endl;
+    while(true){
+        numa_mq.receive(&node, sizeof(node), recvd_size, priority);
+        bool moved = true;
+        for (auto & channel : channels)
+            moved = channel->frameRegion.place(node) && moved;
+        if (moved)
+            std::cout << "Frame buffers placed on NUMA node " << node << std::endl;
+        else
+            std::cerr << "Error: could not place frame buffers on NUMA node " << node << std::endl;
+    }
+}
 
-    
 
-    if (capture.isOpened()){
+// responsible for receiving the policy of the queues to B from the UI, applied to all streams
+// meant to run in a helper thread, since the receive() method is a blocking operation
+void waitForQueuePolicy(std::vector<std::unique_ptr<StreamChannel>> & channels){
+
+    message_queue policy_mq
+        (open_only
+        ,AB_POLICY_Q_NAME
+        );
+
+    unsigned int priority;
+    std::size_t recvd_size;
+    QueuePolicy policy;
+
+    while(true){
+        policy_mq.receive(&policy, sizeof(policy), recvd_size, priority);
+        for (auto & channel : channels)
+            channel->abQueue.set_policy(policy);
+        std::cout << "Queues to B: " << queue_policy_name(policy.policy, policy.nth) << std::endl;
+    }
+}
 
-		std::cout << "Video capture started" << std::endl;
 
-        std::chrono::milliseconds delta(5);                    // leeway for the check if frame came within the frameTime allowed
-        auto prev = std::chrono::system_clock::from_time_t(0); // time the last frame was processed
-        int64_t imageCaptureTime;
+// a source consisting only of digits is a camera number, "synthetic[:WxH]" a generated video (see SyntheticCapture.hpp),
+// anything else is a path to a video file (or an URL)
+bool isCameraSource(const std::string & source){
+    return !source.empty() && source.find_first_not_of("0123456789") == std::string::npos;
+}
 
-		while (true)
-		{
-            capture >> frame;
-            imageCaptureTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+// Asks a camera (or the synthetic source) for frames in one of the given native formats, delivered without conversion
+// to BGR. Returns the format the source agreed to, PIXEL_BGR when it supports none of them (e.g. a camera sending MJPEG).
+int requestNativeFormat(cv::VideoCapture & capture, const std::vector<int> & formats){
+    for (int format : formats){
+        if (!capture.set(cv::CAP_PROP_FOURCC, pixel_fourcc(format)) || (uint32_t)capture.get(cv::CAP_PROP_FOURCC) != pixel_fourcc(format))
+            continue;
+        if (capture.set(cv::CAP_PROP_CONVERT_RGB, 0))
+            return format;
+    }
+    capture.set(cv::CAP_PROP_CONVERT_RGB, 1);
+    return PIXEL_BGR;
+}
 
-             if (frame.empty()){
-                std::cerr << "Error: The image received from the camera is empty" << std::endl;
-				break;
-            }
+// next frame of a source, native frames are returned as a Mat of their pixel format (see native_view()), or empty
+// when the captured data doesn't match the size of the source
+cv::Mat readFrame(cv::VideoCapture & capture, int pixelFormat, bool & captured){
+    cv::Mat frame;
+    capture >> frame;
+    captured = !frame.empty();
+    if (!captured || pixelFormat == PIXEL_BGR)
+        return frame;
+    return native_view(frame, pixelFormat, cv::Size((int)capture.get(cv::CAP_PROP_FRAME_WIDTH), (int)capture.get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
 
-            // measure time since the last frame was processed
-            auto time_elapsed = std::chrono::high_resolution_clock::now() - prev;
+bool openSource(cv::VideoCapture & capture, const std::string & source){
+    if (source.empty()){
+        // some cameras require a different open value, if needed, change it in names.hpp
+        if (!capture.open(CAPTURE_OPEN_VALUE))
+            capture.open(CAPTURE_OPEN_VALUE_2);
+    }
+    else if (isCameraSource(source))
+        capture.open(std::stoi(source));
+    else
+        capture.open(source);
+    return capture.isOpened();
+}
 
-            // if last frame was processed long ago enough to keep up with the fps limit (minus delta) we can process this frame
-            // otherwise this frame is skipped and we collect the next one   
-            if (time_elapsed >= (frameSender.getFrameTime() - delta)){
-                // since this frame was chosen for processing, the time measurement of last frame processed starts now
-                prev = std::chrono::high_resolution_clock::now();
 
+// capture loop of a single stream, meant to run in its own thread
+void captureStream(int stream, cv::VideoCapture & capture, bool replay, bool camera, int pixelFormat, bool deltaFrames, FrameSender & frameSender, StreamChannel & channel,
+                   CaptureResolution & resolution, PipelineStats * stats, RobustMutex & mutexStats, ThreadBudget & threadBudget,
+                   RealtimeMonitor & monitor, PerfCounters & perfCounters){
 
-                // synchronize access and put the frame with its capture's timestamp into shared memory
-                mutexFrame.lock();
-                memcpy(frameRegion.get_address(), &imageCaptureTime, sizeof(int64_t));
-                memcpy((unsigned char*)(frameRegion.get_address()) + sizeof(int64_t), frame.data, frame.cols * frame.rows * frame.channels());
-                mutexFrame.unlock();
+    cv::Mat frame;
+    FrameFormat format = frame_header(channel.frameRegion.get_address())->format;
+    const cv::Size nativeSize(format.cols, format.rows);
+    //resolution frames are published in, 0x0 publishes them as captured
+    cv::Size target(0, 0);
+    unsigned appliedRequest = 0;
+    std::chrono::milliseconds delta(5);                    // leeway for the check if frame came within the frameTime allowed
+    auto prev = std::chrono::system_clock::from_time_t(0); // time the last frame was processed
+    int64_t imageCaptureTime;
+
+    RateController rateController(frameSender.getFps());
+
+    //each capture thread is a worker D may give a deadline reservation
+    mutexStats.lock();
+    RealtimeMonitor::add_worker(stats->process[PROCESS_A]);
+    mutexStats.unlock();
+    auto lastControl = std::chrono::steady_clock::now();
+    int64_t framesPublished = 0;
+
+    //with deltas only the tiles that changed since the previous frame are written into the frame buffer
+    FramePublisher publisher(deltaFrames);
+    double bytesWritten = 0, tilesChanged = 0;
+    int64_t framesMeasured = 0;
+
+    while (true)
+    {
+        threadBudget.poll();
+
+        unsigned request;
+        cv::Size requested = resolution.get(request);
+        if (request != appliedRequest){
+            appliedRequest = request;
+            if (pixel_bytes(pixelFormat, requested.height, requested.width, format.type) > channel.capacity)
+                std::cerr << "Error: " << requested.width << "x" << requested.height << " doesn't fit into the frame buffer of stream "
+                          << stream << ", keeping " << format.cols << "x" << format.rows << std::endl;
+            else {
+                target = requested;
+                //cameras deliver the requested size themselves when they support it, saving the scaling below
+                if (camera){
+                    cv::Size size = target.area() > 0 ? target : nativeSize;
+                    capture.set(cv::CAP_PROP_FRAME_WIDTH, size.width);
+                    capture.set(cv::CAP_PROP_FRAME_HEIGHT, size.height);
+                }
             }
-	    }
+        }
+
+        bool captured;
+        frame = readFrame(capture, pixelFormat, captured);
+        imageCaptureTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        if (!captured && replay){
+            // video files are replayed from the beginning
+            capture.set(cv::CAP_PROP_POS_FRAMES, 0);
+            continue;
+        }
+        if (!captured){
+            std::cerr << "Error: The image received from the camera is empty (stream " << stream << ")" << std::endl;
+            break;
+        }
+        //native data not matching the size of the camera (e.g. while it switches resolution) is dropped
+        if (frame.empty())
+            continue;
+        //native frames are scaled without conversion, they stay in the format of the camera until B and C need BGR
+        if (target.area() > 0 && cv::Size(frame.cols, pixel_image_rows(pixelFormat, frame.rows)) != target)
+            resize_native(frame, pixelFormat, target, frame, cv::INTER_AREA);
+        //a source can't grow beyond the buffer sized for its first frame, such frames are dropped
+        if (frame.total() * frame.elemSize() > channel.capacity)
+            continue;
+
+        // measure time since the last frame was processed
+        auto time_elapsed = std::chrono::high_resolution_clock::now() - prev;
+
+        // if last frame was processed long ago enough to keep up with the fps limit (minus delta) we can process this frame
+        // otherwise this frame is skipped and we collect the next one
+        if (time_elapsed >= (frameSender.getFrameTime() - delta)){
+            // since this frame was chosen for processing, the time measurement of last frame processed starts now
+            prev = std::chrono::high_resolution_clock::now();
+
+
+            //a new version of the format tells B and C to rebuild their views of the frame
+            bool formatChanged = !format.same_as(frame, pixelFormat);
+            if (formatChanged)
+                format = FrameFormat::of(frame, pixelFormat, format.version + 1);
+
+            //a blocking queue holds the frame back until B took the previous ones, instead of overwriting them
+            channel.abQueue.wait_for_room();
+
+            //the changed tiles are found before locking, A is the only writer of the frame buffer
+            publisher.prepare(frame, format, channel.frameRegion.get_address());
+
+            // synchronize access and put the frame with its format and capture's timestamp into shared memory
+            channel.mutexFrame.lock();
+            size_t written = publisher.publish(frame, format, imageCaptureTime, channel.frameRegion.get_address());
+            uint64_t sequence = frame_header(channel.frameRegion.get_address())->sequence;
+            channel.mutexFrame.unlock();
+            channel.abQueue.push(FrameTicket{sequence, imageCaptureTime});
+            ++framesPublished;
+            bytesWritten += written;
+            tilesChanged += (double)publisher.changed_tiles() / publisher.tiles();
+            ++framesMeasured;
+
+            if (formatChanged)
+                std::cout << "Stream " << stream << " publishes " << format.cols << "x" << format.rows << " " << pixel_format_name(pixelFormat)
+                          << " frames (format version " << format.version << ", " << format.bytes() << " bytes)" << std::endl;
+        }
+
+        // periodically adjust the sending rate to the latencies reported by B and C
+        if (std::chrono::steady_clock::now() - lastControl >= std::chrono::milliseconds(RATE_CONTROL_PERIOD_MS)){
+            lastControl = std::chrono::steady_clock::now();
+
+            mutexStats.lock();
+            double latencySlo = frameSender.getLatencySlo();
+            StreamStats & streamStats = stats->stream[stream];
+            if (ADAPTIVE_RATE)
+                frameSender.setRate(rateController.update(frameSender.getFps(), latencySlo, streamStats.latencyMs,
+                                                          stats->inferenceMs, streamStats.renderMs));
+            streamStats.publishFps = frameSender.getRate();
+            streamStats.framesPublished = framesPublished;
+            streamStats.frameCols = format.cols;
+            streamStats.frameRows = format.rows;
+            streamStats.formatVersion = format.version;
+            streamStats.pixelFormat = format.pixelFormat;
+            streamStats.frameBytes = format.bytes();
+            channel.abQueue.report(streamStats.abQueue);
+            if (framesMeasured > 0){
+                streamStats.writtenBytes = bytesWritten / framesMeasured;
+                streamStats.changedTiles = tilesChanged / framesMeasured;
+                bytesWritten = tilesChanged = 0;
+                framesMeasured = 0;
+            }
+            stats->latencySloMs = latencySlo;
+            //faults and cost per frame are sampled for the whole process by the first stream
+            if (stream == 0){
+                int64_t framesOfAllStreams = 0;
+                for (int s = 0; s < stats->streams; ++s)
+                    framesOfAllStreams += stats->stream[s].framesPublished;
+                monitor.sample(stats->process[PROCESS_A], framesOfAllStreams);
+                perfCounters.sample(stats->process[PROCESS_A].perf, framesOfAllStreams);
+            }
+            mutexStats.unlock();
+        }
+    }
+}
+
+
+// usage: A.out [--mlock] [--perf] [--soak] [--reattach] [--native[=yuyv|nv12|auto]] [--delta] [--queue=<policy>] [source ...],
+// every source (camera number, video file or "synthetic") becomes a separate stream, without sources the default
+// camera is used, --mlock locks the memory of the process and prefaults shared memory, --perf enables hardware
+// performance counters, --soak measures wake-up latencies for a soak run, --reattach opens the frame buffers of a
+// running pipeline (A restarted by D),
+// --native publishes frames of cameras in their native YUV format instead of BGR when they support it, --delta writes
+// only the tiles of a frame that changed since the previous one, --queue sets the policy of the queues to B (latest,
+// block or every:<n>, see StageQueue.hpp)
+int main(int argc, char **argv) {
+    
+    //here we define a signal handler and start CPU time tracking to display average CPU usage of the process at the exit
+    signal(SIGINT, handleSIGINT);
+    ThreadBudget::catch_signal();
+    realStart = times(&cpuStart);
+
+    bool lockMemory = false, countPerf = false, soak = false, reattach = false, deltaFrames = false;
+    std::vector<int> nativeFormats;
+    QueuePolicy queuePolicy = {QUEUE_LATEST_WINS, 1};
+    std::vector<std::string> sources;
+    for (int i = 1; i < argc; ++i){
+        if (std::string(argv[i]) == "--mlock")
+            lockMemory = true;
+        else if (std::string(argv[i]) == "--perf")
+            countPerf = true;
+        else if (std::string(argv[i]) == "--soak")
+            soak = true;
+        else if (std::string(argv[i]) == "--reattach")
+            reattach = true;
+        else if (std::string(argv[i]) == "--delta")
+            deltaFrames = true;
+        else if (std::string(argv[i]).compare(0, 8, "--queue=") == 0){
+            if (!parse_queue_policy(std::string(argv[i]).substr(8), queuePolicy))
+                std::cerr << "Error: invalid queue policy " << std::string(argv[i]).substr(8) << ", using latest" << std::endl;
+        }
+        else if (std::string(argv[i]).compare(0, 8, "--native") == 0){
+            std::string name = std::string(argv[i]).size() > 9 ? std::string(argv[i]).substr(9) : "auto";
+            nativeFormats = native_formats(name);
+            if (nativeFormats.empty())
+                std::cerr << "Error: unknown native format " << name << ", publishing BGR" << std::endl;
+        }
+        else
+            sources.push_back(argv[i]);
     }
-	else{
-		std::cerr << "Error: Could not Open Camera";
+    if (sources.empty())
+        sources.push_back("");
+    if (sources.size() > MAX_STREAMS){
+        std::cerr << "Error: at most " << MAX_STREAMS << " streams are supported, ignoring the rest" << std::endl;
+        sources.resize(MAX_STREAMS);
     }
+    int nOfStreams = sources.size();
 
-    capture.release();
+    //opened before any thread is started, so the counters include all threads of the process
+    PerfCounters perfCounters(countPerf);
+
+    //capture threads inherit the affinity set by D, OpenCV threads follow the number of allowed cores
+    ThreadBudget threadBudget("A");
+
+    std::vector<std::unique_ptr<cv::VideoCapture>> captures;
+    std::vector<std::unique_ptr<FrameSender>> frameSenders;
+    std::vector<std::unique_ptr<StreamChannel>> channels;
+    std::vector<int> pixelFormats;
+    CaptureResolution resolution;
+
+    // =================================
+    // INITIAL IPC OBJECTS SETUP BEGIN
+
+    for (int i = 0; i < nOfStreams; ++i){
+        if (SyntheticCapture::handles(sources[i]))
+            captures.emplace_back(new SyntheticCapture());
+        else
+            captures.emplace_back(new cv::VideoCapture());
+        frameSenders.emplace_back(new FrameSender());
+        if (!openSource(*captures[i], sources[i]))
+            std::cerr << "Error: Could not Open Camera (stream " << i << ")" << std::endl;
+
+        //video files are decoded to BGR anyway, only cameras (and the synthetic source) can deliver native frames
+        int pixelFormat = PIXEL_BGR;
+        if (!nativeFormats.empty() && (sources[i].empty() || isCameraSource(sources[i]) || SyntheticCapture::handles(sources[i])))
+            pixelFormat = requestNativeFormat(*captures[i], nativeFormats);
+
+        //read first frame to obtain information about capture, much easier than using capture.get()
+        bool captured;
+        cv::Mat frame = readFrame(*captures[i], pixelFormat, captured);
+        if (pixelFormat != PIXEL_BGR && frame.empty()){
+            std::cerr << "Error: stream " << i << " doesn't deliver " << pixel_format_name(pixelFormat) << " frames, publishing BGR" << std::endl;
+            pixelFormat = PIXEL_BGR;
+            captures[i]->set(cv::CAP_PROP_CONVERT_RGB, 1);
+            frame = readFrame(*captures[i], pixelFormat, captured);
+        }
+        pixelFormats.push_back(pixelFormat);
+        channels.emplace_back(new StreamChannel(i, frame, pixelFormat, queuePolicy, reattach));
+        std::cout << "Stream " << i << " dimensions: " << frame.cols << "x" << pixel_image_rows(pixelFormat, frame.rows)
+                  << " " << pixel_format_name(pixelFormat) << ", frame buffer in " << channels[i]->frameRegion.page_kind() << std::endl;
+    }
+
+    //stats shmem is created by D, A reads latencies measured by B and C from it and reports its own rate
+    RobustMutex mutexStats(open_only, STATS_MUTEX_NAME);
+    shared_memory_object statsShmem(open_only, STATS_SHMEM_NAME, read_write);
+    mapped_region statsRegion(statsShmem, read_write);
+    PipelineStats * stats = static_cast<PipelineStats*>(statsRegion.get_address());
+
+    // INITIAL IPC OBJECTS SETUP END
+    // =================================
+    
+    //counts deadline overruns, optionally keeps the process and its shared memory resident
+    RealtimeMonitor monitor;
+    if (lockMemory){
+        for (auto & channel : channels)
+            RealtimeMonitor::prefault(channel->frameRegion.get_address(), channel->frameRegion.get_size());
+        RealtimeMonitor::prefault(statsRegion.get_address(), statsRegion.get_size());
+        bool locked = monitor.lock_memory();
+        mutexStats.lock();
+        stats->process[PROCESS_A].memoryLocked = locked;
+        mutexStats.unlock();
+    }
+
+    //wake-up jitter of A is measured for the whole soak run
+    std::unique_ptr<WakeupProbe> wakeupProbe;
+    if (soak)
+        wakeupProbe.reset(new WakeupProbe(&stats->process[PROCESS_A], mutexStats));
+
+    //start new threads which listen to coming FPS and latency target changes
+    std::thread fpsListener(waitForFpsChange, std::ref(frameSenders));
+    std::thread sloListener(waitForSloChange, std::ref(frameSenders));
+    std::thread numaListener(waitForNumaNode, std::ref(channels));
+    std::thread resolutionListener(waitForCaptureResolution, std::ref(resolution));
+    std::thread queueListener(waitForQueuePolicy, std::ref(channels));
+    
+    std::cout << "FPS: " << frameSenders[0]->getFps() << std::endl;
+
+    std::vector<std::thread> captureThreads;
+    mutexStats.lock();
+    RealtimeMonitor::clear_workers(stats->process[PROCESS_A]);
+    mutexStats.unlock();
+    for (int i = 0; i < nOfStreams; ++i){
+        if (!captures[i]->isOpened())
+            continue;
+        bool replay = !sources[i].empty() && !isCameraSource(sources[i]) && !SyntheticCapture::handles(sources[i]);
+        captureThreads.emplace_back(captureStream, i, std::ref(*captures[i]), replay, isCameraSource(sources[i]) || sources[i].empty(),
+                                    pixelFormats[i], deltaFrames, std::ref(*frameSenders[i]), std::ref(*channels[i]), std::ref(resolution), stats,
+                                    std::ref(mutexStats), std::ref(threadBudget), std::ref(monitor), std::ref(perfCounters));
+    }
+    std::cout << "Video capture started" << std::endl;
+
+    for (auto & t : captureThreads)
+        t.join();
+
+    for (auto & capture : captures)
+        capture->release();
     
     fpsListener.join();
+    sloListener.join();
+    numaListener.join();
+    resolutionListener.join();
+    queueListener.join();
     return 0;
 
-}
\ No newline at end of file
+}
@@ -1,12 +1,27 @@
 // This process is responsible for detecting faces in each frame received from process A.
-// The coordinates of all faces in a frame are then forwarded to process B.
+// The coordinates of all faces in a frame are then forwarded to process C.
+// Latest frames of all streams are detected together in a single batched forward pass.
 
 #include "names.hpp"
+#include "ipc.hpp"
+#include "RobustMutex.hpp"
+#include "FrameBuffer.hpp"
+#include "FrameFormat.hpp"
+#include "stats.hpp"
+#include "FaceDetector.hpp"
+#include "detector_options.hpp"
+#include "precision_check.hpp"
+#include "StreamScheduler.hpp"
+#include "StageQueue.hpp"
+#include "ThreadBudget.hpp"
+#include "realtime.hpp"
+#include "PerfCounters.hpp"
+#include "soak.hpp"
 
-#include <boost/interprocess/sync/named_mutex.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/program_options.hpp>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/dnn.hpp>
@@ -15,12 +30,19 @@
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <sys/times.h>
 #include <signal.h>
 
 using namespace boost::interprocess;
 
+void reportResolutions();
+
 // vars used to calculate CPU usage by comparing CPU time used and real time passed
 tms cpuStart, cpuEnd;
 time_t realStart, realEnd;
@@ -35,202 +57,733 @@ void handleSIGINT(int sig)
     cpuTime = (long)(cpuEnd.tms_utime - cpuStart.tms_utime);
     percentageOfTime = (double)(cpuTime) / (double)(realTime) * 100.0;
     std::cout << "Process B with PID: " << getpid() << "\t percentage of CPU time: " << percentageOfTime << "%" << std::endl;
+    reportResolutions();
     exit(0);
 }
 
 
-class FaceDetector {
-
+// Chooses the input size of the detection network at runtime.
+// The size goes down when inference takes longer than INFERENCE_BUDGET_MS or when the smallest face is large enough
+// to be found at a lower resolution, and goes up when small faces (or none at all) are seen and the predicted
+// inference time at the bigger size still fits the budget. The size can also be forced from the UI.
+class ResolutionScaler {
 private:
-    //requires prototxt file and pretrained Caffe model(with weights)
-    cv::dnn::Net detection_network;
+    //available input sizes, ascending
+    std::vector<int> sizes;
+    int current;
+    //size forced by the UI, 0 means automatic choice
+    int forced;
+    std::mutex forced_mutex;
+
+    //moving average of inference time at the current size
+    double inference_avg;
+    int frames_since_change;
+    std::chrono::steady_clock::time_point current_since;
+
+    //per size totals used in the report
+    std::vector<long> frames;
+    std::vector<double> inference_total;
+    std::vector<double> seconds_spent;
+
+    //number of frames measured at a new size before another change is considered
+    static const int SETTLE_FRAMES = 15;
+    //smallest face (in pixels of the network input) above which the size is lowered
+    static const int LARGE_FACE = 96;
+    //smallest face below which a bigger size is tried
+    static const int SMALL_FACE = 32;
+
+    void change_to(int index) {
+        auto now = std::chrono::steady_clock::now();
+        seconds_spent[current] += std::chrono::duration<double>(now - current_since).count();
+        current_since = now;
+        current = index;
+        inference_avg = 0.0;
+        frames_since_change = 0;
+    }
+
+public:
+    static const int DEFAULT_SIZE = 300;
+
+    ResolutionScaler() : sizes({160, 224, 300, 400, 480}), forced(0), inference_avg(0.0), frames_since_change(0) {
+        current = std::find(sizes.begin(), sizes.end(), (int)DEFAULT_SIZE) - sizes.begin();
+        current_since = std::chrono::steady_clock::now();
+        frames.assign(sizes.size(), 0);
+        inference_total.assign(sizes.size(), 0.0);
+        seconds_spent.assign(sizes.size(), 0.0);
+    }
 
-    int image_width;
-    int image_height;
-    int image_scale;
-    //mean values network was trained with
-    cv::Scalar mean_val;
-    //confidence (default 0.5)
-    float confidence_threshold;
+    int size() const {
+        return sizes[current];
+    }
 
+    void set_forced(int size) {
+        forced_mutex.lock();
+        forced = size;
+        forced_mutex.unlock();
+    }
 
-public:
-    //detect faces in image
-    explicit FaceDetector();
+    //called after every inference with the time a forward pass over frames of all streams takes, smallest_face is
+    //the smaller side of the smallest detected face in pixels of the network input (0 if no face was found);
+    //returns the size to use for the next frame
+    int update(double inference_ms, int smallest_face) {
+        frames[current]++;
+        inference_total[current] += inference_ms;
+        updateAverage(inference_avg, inference_ms);
+        frames_since_change++;
+
+        forced_mutex.lock();
+        int forced_size = forced;
+        forced_mutex.unlock();
+
+        if (forced_size != 0) {
+            auto it = std::find(sizes.begin(), sizes.end(), forced_size);
+            if (it != sizes.end() && it - sizes.begin() != current)
+                change_to(it - sizes.begin());
+            return size();
+        }
 
-    //return list of detected faces
-    std::vector<int> detected_face(const cv::Mat &frame) ;
-};
+        if (frames_since_change < SETTLE_FRAMES)
+            return size();
 
+        bool can_go_down = current > 0;
+        bool can_go_up = current + 1 < (int)sizes.size();
 
-FaceDetector::FaceDetector() :
-        //increasing confidence val is not recommended, deacreasing will cause false-positves
-        confidence_threshold(0.5),
-        image_width(300),
-        image_height(300),
-        image_scale(1.0),
-        //values model was trained with
-        mean_val({104., 177.0, 123.0}) {
-    //detection network model files (.prototext configuration and .caffemodel binary)
-    //source github.com/spmallick/learnopencv/tree/master/FaceDetectionComparison/models
-    detection_network = cv::dnn::readNetFromCaffe(FACE_DETECTION_CONFIGURATION, FACE_DETECTION_WEIGHTS);
-    if (detection_network.empty()) {
-        std::cerr<<"ERROR: could not read network";
+        if (can_go_down && (inference_avg > INFERENCE_BUDGET_MS || smallest_face > LARGE_FACE)) {
+            change_to(current - 1);
+        } else if (can_go_up && smallest_face < SMALL_FACE) {
+            //inference cost grows with the number of input pixels
+            double ratio = (double)sizes[current + 1] / sizes[current];
+            if (inference_avg * ratio * ratio < INFERENCE_BUDGET_MS)
+                change_to(current + 1);
+        }
+        return size();
     }
 
+    void report() {
+        change_to(current);
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            std::cout << "\t input " << sizes[i] << "x" << sizes[i] << ": " << frames[i] << " frames, ";
+            if (frames[i] > 0)
+                std::cout << "avg inference " << inference_total[i] / frames[i] << " ms, ";
+            std::cout << "time spent " << seconds_spent[i] << " s" << std::endl;
+        }
+    }
+};
 
+//used by the SIGINT handler to print time spent at each detector input size
+ResolutionScaler * resolutionScaler = nullptr;
+
+void reportResolutions() {
+    if (resolutionScaler != nullptr)
+        resolutionScaler->report();
 }
 
-std::vector<int> FaceDetector::detected_face(const cv::Mat &frame) {
-    //transform frame to data blop (resize and rescale img)
-    cv::Mat input_blob = cv::dnn::blobFromImage(frame, image_scale, cv::Size(image_width, image_height), mean_val, false, false);
+// responsible for receiving a forced detector input size from the UI (0 restores the automatic choice)
+// meant to run in a helper thread, since the receive() method is a blocking operation
+void wait_for_resolution_change(ResolutionScaler & scaler) {
 
-    //forward blop through network and save data in detection_matrix
-    detection_network.setInput(input_blob, "data");
-    cv::Mat detection = detection_network.forward("detection_out");
-    cv::Mat detection_matrix(detection.size[2], detection.size[3], CV_32F, detection.ptr<float>());
+    message_queue mq
+            (open_only
+            ,RESOLUTION_Q_NAME
+            );
+
+    unsigned int priority;
+    std::size_t recvd_size;
+    int new_size;
+
+    while(true){
+        mq.receive(&new_size, sizeof(new_size), recvd_size, priority);
+        scaler.set_forced(new_size);
+    }
+}
 
-    std::vector<int> faces;
 
-    for (int i = 0; i < detection_matrix.rows; i++) {
-        float confidence = detection_matrix.at<float>(i, 2);
 
-        if (confidence > confidence_threshold) {
-            //left bottom pixel
-            int x1 = static_cast<int>(detection_matrix.at<float>(i, 3) * frame.cols);
-            int y1 = static_cast<int>(detection_matrix.at<float>(i, 4) * frame.rows);
 
-            //right top pixel
-            int x2 = static_cast<int>(detection_matrix.at<float>(i, 5) * frame.cols);
-            int y2 = static_cast<int>(detection_matrix.at<float>(i, 6) * frame.rows);
-            
-            //we need to store primitive values needed to construct a cv::Rect so we can put them into shmem
-            //since objects of custom class in shmem cause multiple problems
+// creates the detector in the chosen inference mode; a reduced precision mode is compared with fp32 on the reference
+// clip: the same model in fp32, or for a model file quantized to int8 already the fp32 model it was made from
+std::unique_ptr<FaceDetector> create_detector(const DetectorConfig &config, const InferenceMode &mode,
+                                              const std::vector<cv::Mat> &clip, double min_agreement, bool &check_passed) {
+    std::unique_ptr<FaceDetector> detector = make_face_detector(config);
+    if (!detector || !detector->loaded())
+        return nullptr;
 
-            //we store x,y of left bottom pixel, width and height
-            faces.push_back(x1);
-            faces.push_back(y1);
-            faces.push_back(x2 - x1);
-            faces.push_back(y2 - y1);
+    bool quantize = mode.precision == "int8" && mode.quantize;
+    std::string description = detector->set_inference_mode(mode, quantize ? clip : std::vector<cv::Mat>());
+    std::cout << "Inference mode: " << description << std::endl;
+    check_passed = true;
 
+    if (!clip.empty() && mode.precision != "fp32" && description.compare(0, 4, "fp32") != 0) {
+        DetectorConfig reference_config = config;
+        if (mode.precision == "int8" && !quantize) {
+            if (config.reference_model.empty() && config.backend == "onnx") {
+                std::cerr << "Error: checking a quantized onnx model requires --reference-model, the fp32 model" << std::endl;
+                check_passed = false;
+                return detector;
+            }
+            reference_config.model = config.reference_model;
+        }
+        std::unique_ptr<FaceDetector> reference = make_face_detector(reference_config);
+        if (!reference || !reference->loaded()) {
+            std::cerr << "Error: could not load the fp32 reference model, precision not checked" << std::endl;
+            check_passed = false;
+            return detector;
+        }
+        InferenceMode fp32_mode;
+        fp32_mode.backend = mode.backend;
+        reference->set_inference_mode(fp32_mode, std::vector<cv::Mat>());
+
+        PrecisionReport report = check_precision(*reference, *detector, clip, min_agreement);
+        print_precision_report(report, description);
+        check_passed = report.passed;
+        if (!report.passed) {
+            std::cerr << "Detections differ too much from fp32, falling back to fp32" << std::endl;
+            return reference;
         }
+    }
+    return detector;
+}
+
 
+// Replaces the detector while B keeps running, on request from the UI (detector options as on the command line, e.g.
+// "--confidence 0.7" or "--detector onnx --model face.onnx"). The new detector is created and warmed up on the latest
+// frames in a helper thread while the old one keeps detecting, then the main loop takes it between two rounds. Every
+// frame is detected by either the old or the new detector, so no frame reaches C without its faces. The old detector
+// is destroyed in the helper thread as well. Preparation time, the switch itself and the inference time of the rounds
+// right after the switch compared to the rounds before it are reported to D.
+class DetectorSwapper {
+private:
+    DetectorConfig config;
+    InferenceMode mode;
+    const std::vector<cv::Mat> & clip;
+    double min_agreement;
+
+    std::mutex mutex;
+    //warmed up detector waiting for the main loop, and the detector it replaced
+    std::unique_ptr<FaceDetector> ready;
+    std::unique_ptr<FaceDetector> retired;
+    double prepare_ms;
+
+    //frames the new detector is warmed up on, copied by the main loop on request
+    std::atomic<bool> wants_frames;
+    std::vector<cv::Mat> warmup_frames;
+
+    //observation of the rounds after a switch, used by the main loop only
+    int rounds_observed;
+    double inference_before_ms;
+    double inference_after_max_ms;
+    double switch_ms;
+
+    //number of forward passes on the warm-up frames, the first one allocates the network
+    static const int WARMUP_PASSES = 3;
+    //rounds after a switch in which the inference time is compared with the time before it
+    static const int OBSERVED_ROUNDS = 30;
+
+    bool parse(const std::string & request, DetectorConfig & new_config, InferenceMode & new_mode) {
+        boost::program_options::options_description options;
+        add_detector_options(options, new_config, new_mode);
+        try {
+            boost::program_options::variables_map vm;
+            boost::program_options::store(boost::program_options::command_line_parser(
+                    boost::program_options::split_unix(request)).options(options).run(), vm);
+            boost::program_options::notify(vm);
+            //the model files of another backend don't apply to the new one
+            if (new_config.backend != config.backend && !vm.count("model")) {
+                new_config.model.clear();
+                new_config.config.clear();
+            }
+        } catch (const boost::program_options::error & e) {
+            std::cerr << "Error: invalid detector request \"" << request << "\": " << e.what() << std::endl;
+            return false;
+        }
+        return true;
     }
-    //insert size of array as first element so process C can read it
-    faces.insert(faces.begin(), faces.size());
-    return faces;
 
-}
+    std::vector<cv::Mat> latest_frames() {
+        wants_frames = true;
+        for (int i = 0; i < 100 && wants_frames; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (wants_frames || warmup_frames.empty()) {
+            //B doesn't get frames, warm up on a blank one
+            wants_frames = false;
+            return std::vector<cv::Mat>{cv::Mat::zeros(480, 640, CV_8UC3)};
+        }
+        return warmup_frames;
+    }
 
+    void prepare(const std::string & request, int input_size) {
+        DetectorConfig new_config = config;
+        InferenceMode new_mode = mode;
+        if (!parse(request, new_config, new_mode))
+            return;
+
+        auto start = std::chrono::steady_clock::now();
+        bool precision_passed = false;
+        std::unique_ptr<FaceDetector> detector = create_detector(new_config, new_mode, clip, min_agreement, precision_passed);
+        if (!detector) {
+            std::cerr << "Error: could not load detector \"" << request << "\", keeping the current one" << std::endl;
+            return;
+        }
+        detector->set_input_size(input_size);
+        std::vector<cv::Mat> frames = latest_frames();
+        for (int i = 0; i < WARMUP_PASSES; ++i)
+            detector->detected_faces(frames);
+        std::chrono::duration<double, std::milli> prepared = std::chrono::steady_clock::now() - start;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ready = std::move(detector);
+        prepare_ms = prepared.count();
+        config = new_config;
+        mode = new_mode;
+    }
 
+public:
+    DetectorSwapper(const DetectorConfig & initial_config, const InferenceMode & initial_mode,
+                    const std::vector<cv::Mat> & reference_clip, double agreement) :
+            config(initial_config), mode(initial_mode), clip(reference_clip), min_agreement(agreement), prepare_ms(0.0),
+            wants_frames(false), rounds_observed(OBSERVED_ROUNDS), inference_before_ms(0.0), inference_after_max_ms(0.0),
+            switch_ms(0.0) {}
+
+    //receives detector requests from the UI, meant to run in a helper thread
+    void listen(ResolutionScaler & scaler) {
+        message_queue mq(open_only, DETECTOR_Q_NAME);
+        char request[DETECTOR_REQUEST_SIZE];
+        unsigned int priority;
+        std::size_t recvd_size;
+
+        while (true) {
+            mq.receive(request, sizeof(request), recvd_size, priority);
+            std::string text(request, strnlen(request, recvd_size));
+            std::cout << "Preparing detector: " << text << std::endl;
+            prepare(text, scaler.size());
+
+            //the replaced detector is destroyed here, not in the main loop
+            while (true) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!ready) {
+                    retired.reset();
+                    break;
+                }
+            }
+        }
+    }
 
+    //called by the main loop after every round with the frames of the round
+    void offer_frames(const std::vector<cv::Mat> & frames) {
+        if (!wants_frames)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        warmup_frames.clear();
+        for (const auto & frame : frames)
+            warmup_frames.push_back(frame.clone());
+        wants_frames = false;
+    }
 
-int main () {
-    //here we define a signal handler and start CPU time tracking to display average CPU usage of the process at the exit
-    signal(SIGINT, handleSIGINT);
-    realStart = times(&cpuStart);
-    
-    // =================================
-    // INITIAL IPC OBJECTS SETUP BEGIN
+    //called by the main loop between two rounds, replaces detector when a new one is ready
+    bool swap(std::unique_ptr<FaceDetector> & detector, double inference_ms) {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || !ready)
+            return false;
+        auto start = std::chrono::steady_clock::now();
+        ready->set_input_size(detector->get_input_size());
+        retired = std::move(detector);
+        detector = std::move(ready);
+        switch_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        inference_before_ms = inference_ms;
+        inference_after_max_ms = 0.0;
+        rounds_observed = 0;
+        return true;
+    }
 
-    //removers make sure that IPC resource does get removed and we will not have errors creating a new ones
+    //called by the main loop after every round, the caller holds the stats mutex
+    void observe(double inference_ms, PipelineStats * stats) {
+        if (rounds_observed >= OBSERVED_ROUNDS)
+            return;
+        inference_after_max_ms = std::max(inference_after_max_ms, inference_ms);
+        if (++rounds_observed < OBSERVED_ROUNDS)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        stats->detectorSwaps++;
+        stats->swapPrepareMs = prepare_ms;
+        stats->swapSwitchMs = switch_ms;
+        stats->swapBlipMs = std::max(0.0, inference_after_max_ms - inference_before_ms);
+        std::cout << "Detector switched: prepared in " << prepare_ms << " ms, switch took " << switch_ms << " ms, inference "
+                  << inference_before_ms << " ms before, at most " << inference_after_max_ms << " ms in the "
+                  << OBSERVED_ROUNDS << " rounds after" << std::endl;
+    }
+};
 
-    //syncing with process C
-    struct q_remover{
-        q_remover(){ boost::interprocess::message_queue::remove(BC_SYNC_Q_NAME); }
-        ~q_remover(){ boost::interprocess::message_queue::remove(BC_SYNC_Q_NAME); }
-    } remover;
 
-    boost::interprocess::message_queue bc_mq
-         (boost::interprocess::create_only               //only create
-         ,BC_SYNC_Q_NAME    //name
-         ,500                        //max message number
-         ,sizeof(char)               //max message size
-         );
+// IPC objects of a single stream: B creates the faces shmem and the queue used to sync with C,
+// frame shmem and the queue of frames to detect are opened, since they are created by A
+struct StreamChannel {
 
+    //removers make sure that IPC resource does get removed and we will not have errors creating a new ones
+    IpcRemover<StageQueue> queueRemover;
+    IpcRemover<shared_memory_object> facesShmemRemover;
+    IpcRemover<RobustMutex> facesMutexRemover;
 
+    //syncing with process C, a ticket for every frame whose faces are ready
+    StageQueue bcQueue;
+    //frames published by A
+    StageQueue abQueue;
 
     // save faces:
-    struct shm_remove
+    shared_memory_object facesShmem;
+    mapped_region facesRegion;
+    RobustMutex mutexFaces;
+
+    //get image
+    FrameBuffer regionFrame;
+    RobustMutex mutexFrame;
+
+    int stream;
+    //format of the frames in regionFrame, read from the frame buffer
+    FrameFormat format;
+    cv::Mat frame;
+
+    //sequence and capture time of the frame gathered in this round and sequence of the last frame faces were detected
+    //in; the faces of the last detection are kept to be reused for frames that barely changed
+    uint64_t frameSequence;
+    int64_t captureTime;
+    uint64_t detectedSequence;
+    std::vector<int> faces;
+    FacesHeader facesSize;
+
+    //after a restart (reattach) the objects still used by C are opened, otherwise they are new
+    StreamChannel(int stream, const QueuePolicy & queuePolicy, bool reattach) :
+        queueRemover(streamName(BC_SYNC_Q_NAME, stream), reattach),
+        facesShmemRemover(streamName(FACES_SHMEM_NAME, stream), reattach),
+        facesMutexRemover(streamName(FACES_MUTEX_NAME, stream), reattach),
+        bcQueue(open_or_create, queueRemover.name.c_str(), queuePolicy),
+        abQueue(open_only, streamName(AB_SYNC_Q_NAME, stream).c_str()),
+        facesShmem(open_or_create, facesShmemRemover.name.c_str(), read_write),
+        mutexFaces(open_or_create, facesMutexRemover.name.c_str()),
+        regionFrame(open_only, streamName(FRAME_SHMEM_NAME, stream).c_str(), read_only),
+        mutexFrame(open_only, streamName(FRAME_MUTEX_NAME, stream).c_str()),
+        stream(stream),
+        format(),
+        frameSequence(0),
+        captureTime(0),
+        detectedSequence(0),
+        facesSize{0, 0, 0}
     {
-        shm_remove() { shared_memory_object::remove(FACES_SHMEM_NAME);}
-        ~shm_remove() { shared_memory_object::remove(FACES_SHMEM_NAME);}
-    } shm_remover;
-    shared_memory_object facesShmem(create_only, FACES_SHMEM_NAME, read_write);
-    facesShmem.truncate(1024*16);
-    mapped_region facesRegion(facesShmem, read_write);
+        facesShmem.truncate(1024*16);
+        mapped_region region(facesShmem, read_write);
+        facesRegion.swap(region);
+    }
 
+    //view of the frame in shmem, rebuilt when A publishes frames of another format; the caller holds mutexFrame
+    const cv::Mat & current_frame() {
+        const FrameFormat & published = frame_header(regionFrame.get_address())->format;
+        if (published.version != format.version) {
+            if (format.version != 0)
+                std::cout << "Stream " << stream << ": frame format changed to " << published.cols << "x" << published.rows
+                          << " " << pixel_format_name(published.pixelFormat) << std::endl;
+            format = published;
+            frame = format.view(frame_pixels(regionFrame.get_address()));
+            //faces of frames of another format are never reused
+            detectedSequence = 0;
+        }
+        frameSequence = frame_header(regionFrame.get_address())->sequence;
+        captureTime = frame_header(regionFrame.get_address())->captureTime;
+        return frame;
+    }
 
+    //share of the tiles A marked as changed since the frame faces were last detected in, 1 when there is no such frame
+    //in the current format; the caller holds mutexFrame
+    double changed_share() const {
+        const FrameSlotHeader * header = frame_header(regionFrame.get_address());
+        int tiles = header->tilesX * header->tilesY;
+        if (detectedSequence == 0 || tiles == 0)
+            return 1.0;
+        return (double)tiles_changed_since(header, detectedSequence) / tiles;
+    }
+};
 
-    struct mutex_remove
-    {
-        mutex_remove() { named_mutex::remove(FACES_MUTEX_NAME); }
-        ~mutex_remove(){ named_mutex::remove(FACES_MUTEX_NAME); }
-    } BCmutex_remover;
-    named_mutex mutexFaces(create_only, FACES_MUTEX_NAME);
 
+// responsible for receiving the policy of the queues to C from the UI, applied to all streams
+// meant to run in a helper thread, since the receive() method is a blocking operation
+void wait_for_queue_policy(std::vector<std::unique_ptr<StreamChannel>> & channels) {
 
-    //get image
-    shared_memory_object segmentFrame(open_only, FRAME_SHMEM_NAME, read_only);
-    mapped_region regionFrame(segmentFrame, read_only);
-    named_mutex mutexFrame(open_only, FRAME_MUTEX_NAME);
+    message_queue mq
+            (open_only
+            ,BC_POLICY_Q_NAME
+            );
 
+    unsigned int priority;
+    std::size_t recvd_size;
+    QueuePolicy policy;
 
-    
-    named_mutex mutexFramesize(open_only, FRAMESIZE_MUTEX);
+    while(true){
+        mq.receive(&policy, sizeof(policy), recvd_size, priority);
+        for (auto & channel : channels)
+            channel->bcQueue.set_policy(policy);
+        std::cout << "Queues to C: " << queue_policy_name(policy.policy, policy.nth) << std::endl;
+    }
+}
+
+
+int main (int argc, char **argv) {
+    //here we define a signal handler and start CPU time tracking to display average CPU usage of the process at the exit
+    signal(SIGINT, handleSIGINT);
+    ThreadBudget::catch_signal();
+    realStart = times(&cpuStart);
+
+    int nOfStreams;
+    DetectorConfig detectorConfig;
+    InferenceMode inferenceMode;
+    int threads;
+    std::string referenceClip;
+    double minAgreement;
+    double motionGating;
+    std::string bcQueue;
+
+    namespace po = boost::program_options;
+    po::options_description options("Process B options");
+    options.add_options()
+        ("streams", po::value<int>(&nOfStreams)->default_value(1), "number of video streams");
+    add_detector_options(options, detectorConfig, inferenceMode);
+    options.add_options()
+        ("threads", po::value<int>(&threads)->default_value(0), "number of OpenCV threads, 0 follows the CPU affinity")
+        ("reference-clip", po::value<std::string>(&referenceClip), "video used to check the precision against fp32 (and to calibrate int8 with --quantize)")
+        ("min-agreement", po::value<double>(&minAgreement)->default_value(0.95), "minimal recall and precision relative to fp32")
+        ("bc-queue", po::value<std::string>(&bcQueue)->default_value("latest"), "policy of the queues to C: latest, block or every:<n>")
+        ("motion-gating", po::value<double>(&motionGating)->default_value(-1), "reuse the faces of the last detection while at most this share of tiles changed (0 for identical frames, negative disables)")
+        ("mlock", "lock the memory of the process and prefault shared memory")
+        ("perf", "count cycles, instructions, cache and branch misses and context switches per frame")
+        ("soak", "measure wake-up latencies for a soak run")
+        ("reattach", "open the IPC objects of a running pipeline instead of creating them (B restarted by D)")
+        ("check-only", "run the precision check and exit, the exit code tells if it passed");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+    nOfStreams = std::max(1, std::min(nOfStreams, MAX_STREAMS));
+    QueuePolicy queuePolicy = {QUEUE_LATEST_WINS, 1};
+    if (!parse_queue_policy(bcQueue, queuePolicy))
+        std::cerr << "Error: invalid queue policy " << bcQueue << ", using latest" << std::endl;
+
+    //opened before the OpenCV thread pool is started, so the counters include its threads
+    PerfCounters perfCounters(vm.count("perf") > 0);
+
+    //one OpenCV thread per core B is allowed to run on, updated when D changes the affinity
+    ThreadBudget threadBudget("B", threads);
+
+    //frames of the reference clip are used to compare the mode with fp32 and, with --quantize, to quantize the network
+    std::vector<cv::Mat> clip;
+    if (!referenceClip.empty())
+        clip = read_clip(referenceClip, 100);
+
+    if (vm.count("check-only")) {
+        if (clip.empty() || inferenceMode.precision == "fp32") {
+            std::cerr << "Error: precision check requires --reference-clip and a precision other than fp32" << std::endl;
+            return 1;
+        }
+        bool passed = false;
+        create_detector(detectorConfig, inferenceMode, clip, minAgreement, passed);
+        return passed ? 0 : 1;
+    }
 
-    shared_memory_object framesizeInfo(open_only, FRAMESIZE_SHMEM, read_only);
-    mapped_region framesizeRegion(framesizeInfo, read_only);
+    // =================================
+    // INITIAL IPC OBJECTS SETUP BEGIN
+
+    std::vector<std::unique_ptr<StreamChannel>> channels;
+    for (int i = 0; i < nOfStreams; ++i)
+        channels.emplace_back(new StreamChannel(i, queuePolicy, vm.count("reattach") > 0));
+
+    //inference time is reported to D and to the rate controller in A
+    RobustMutex mutexStats(open_only, STATS_MUTEX_NAME);
+    shared_memory_object statsShmem(open_only, STATS_SHMEM_NAME, read_write);
+    mapped_region statsRegion(statsShmem, read_write);
+    PipelineStats * stats = static_cast<PipelineStats*>(statsRegion.get_address());
     // INITIAL IPC OBJECTS SETUP END
     // =================================
 
-    long framesize[3];
-   
-    mutexFramesize.lock();
-    memcpy(framesize, framesizeRegion.get_address(), sizeof(framesize));
-    mutexFramesize.unlock();
+    //counts deadline overruns, optionally keeps the process and its shared memory resident
+    RealtimeMonitor monitor;
+    if (vm.count("mlock")) {
+        for (auto & channel : channels) {
+            RealtimeMonitor::prefault(channel->regionFrame.get_address(), channel->regionFrame.get_size());
+            RealtimeMonitor::prefault(channel->facesRegion.get_address(), channel->facesRegion.get_size());
+        }
+        RealtimeMonitor::prefault(statsRegion.get_address(), statsRegion.get_size());
+        bool locked = monitor.lock_memory();
+        mutexStats.lock();
+        stats->process[PROCESS_B].memoryLocked = locked;
+        mutexStats.unlock();
+    }
+
+    //wake-up jitter of B is measured for the whole soak run
+    std::unique_ptr<WakeupProbe> wakeupProbe;
+    if (vm.count("soak"))
+        wakeupProbe.reset(new WakeupProbe(&stats->process[PROCESS_B], mutexStats));
+
+    bool precisionPassed = false;
+    std::unique_ptr<FaceDetector> detector = create_detector(detectorConfig, inferenceMode, clip, minAgreement, precisionPassed);
+    if (!detector)
+        return 1;
+    ResolutionScaler scaler;
+    resolutionScaler = &scaler;
+    detector->set_input_size(scaler.size());
+
+    //decides which streams fit into the inference budget in every round
+    StreamScheduler scheduler(nOfStreams, INFERENCE_BUDGET_MS);
 
-    int64_t imageProcessedTime, imageCaptureTime;
+    //thread which listens for detector input size forced from the UI
+    std::thread resolution_listener(wait_for_resolution_change, std::ref(scaler));
 
+    //thread which loads detectors requested from the UI, they replace the current one between two rounds
+    DetectorSwapper swapper(detectorConfig, inferenceMode, clip, minAgreement);
+    std::thread detector_listener(&DetectorSwapper::listen, &swapper, std::ref(scaler));
 
-    FaceDetector face_detector;
+    //thread which applies the queue policy set from the UI
+    std::thread queue_listener(wait_for_queue_policy, std::ref(channels));
     
-    //this value is ignored, but needed to communicate via message q
-    char whatever = 0;
+    //the detection loop is the only worker of B D may give a deadline reservation, the OpenCV pool stays as it is
+    mutexStats.lock();
+    RealtimeMonitor::clear_workers(stats->process[PROCESS_B]);
+    RealtimeMonitor::add_worker(stats->process[PROCESS_B]);
+    mutexStats.unlock();
+
+    int64_t rounds = 0;
 
     while(true) {
+        threadBudget.poll();
+        //the stats are shared with D and the stats thread, read them only under their mutex
+        mutexStats.lock();
+        double inferenceMs = stats->inferenceMs;
+        mutexStats.unlock();
+        swapper.swap(detector, inferenceMs);
   
-        
-        mutexFrame.lock();
-        memcpy(&imageCaptureTime, regionFrame.get_address(), sizeof(int64_t));
-        cv::Mat img(framesize[0], framesize[1],
-                            framesize[2],
-                            (unsigned char*)(regionFrame.get_address()) + sizeof(int64_t),
-                            cv::Mat::AUTO_STEP);
-        mutexFrame.unlock();
+        std::vector<int> batch = scheduler.next_batch();
+
+        //gather the latest frame of every stream chosen for this round that A published a frame for since the last one;
+        //with motion gating a frame in which A marked at most the given share of tiles as changed since the last
+        //detection keeps the faces of that detection
+        //A rewrites the tiles of the slot in place, so the detector input is made while mutexFrame is held: native
+        //frames are scaled to the detector input while still in YUV and only the scaled pixels are converted to BGR,
+        //BGR frames are copied; faces are then found in these frames, C scales them to its frames by the size sent
+        //along with them
+        std::vector<cv::Mat> images;
+        std::vector<int> detected;
+        std::vector<int> processed;
+        std::vector<bool> gated(nOfStreams, false);
+        std::chrono::duration<double, std::milli> prepareTime(0);
+        bool prepared = false;
+        for (int s : batch) {
+            StreamChannel & channel = *channels[s];
+            FrameTicket ticket;
+            if (!channel.abQueue.try_pop_newer(channel.frameSequence, ticket))
+                continue;
+            processed.push_back(s);
+            cv::Mat input;
+            channel.mutexFrame.lock();
+            const cv::Mat & frame = channel.current_frame();
+            gated[s] = motionGating >= 0 && channel.changed_share() <= motionGating;
+            if (!gated[s]) {
+                if (channel.format.pixelFormat == PIXEL_BGR) {
+                    frame.copyTo(input);
+                } else {
+                    auto prepareStart = std::chrono::steady_clock::now();
+                    scaled_bgr(frame, channel.format.pixelFormat, detector->detection_size(channel.format.size()), input);
+                    prepareTime += std::chrono::steady_clock::now() - prepareStart;
+                    prepared = true;
+                }
+            }
+            channel.mutexFrame.unlock();
+            if (gated[s])
+                continue;
+            images.push_back(input);
+            detected.push_back(s);
+        }
 
- 
-        imageProcessedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-        std::vector<int> result = face_detector.detected_face(img);
+        //no stream has a new frame, B waits for one instead of spinning
+        if (processed.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_POLL_MS));
+            continue;
+        }
+
+        std::chrono::duration<double, std::milli> inferenceTime(0);
+        if (!detected.empty()) {
+            auto inferenceStart = std::chrono::steady_clock::now();
+            std::vector<std::vector<int>> results = detector->detected_faces(images);
+            inferenceTime = std::chrono::steady_clock::now() - inferenceStart;
+            scheduler.batch_done(detected.size(), inferenceTime.count());
+            swapper.offer_frames(images);
+
+            //smaller side of the smallest face of all streams, in pixels of the network input
+            int smallestFace = 0;
+            for (size_t d = 0; d < detected.size(); ++d) {
+                StreamChannel & channel = *channels[detected[d]];
+                channel.faces = results[d];
+                channel.facesSize = {images[d].cols, images[d].rows};
+                channel.detectedSequence = channel.frameSequence;
+                const std::vector<int> & result = results[d];
+                for (size_t i = 1; i + 3 < result.size(); i += 4) {
+                    int face = std::min(result[i+2] * detector->get_input_size() / images[d].cols,
+                                        result[i+3] * detector->get_input_size() / images[d].rows);
+                    if (smallestFace == 0 || face < smallestFace)
+                        smallestFace = face;
+                }
+            }
+            //resolution is chosen for a round with frames of all streams, so it is lowered before any stream gets shed
+            detector->set_input_size(scaler.update(inferenceTime.count() * nOfStreams / detected.size(), smallestFace));
+        }
+
+        mutexStats.lock();
+        if (!detected.empty()) {
+            updateAverage(stats->inferenceMs, inferenceTime.count());
+            swapper.observe(inferenceTime.count(), stats);
+        }
+        stats->inputSize = detector->get_input_size();
+        stats->batchSize = detected.size();
+        if (prepared)
+            updateAverage(stats->prepareMs, prepareTime.count());
+        for (int s : processed)
+            ++(gated[s] ? stats->stream[s].framesGated : stats->stream[s].framesDetected);
+        for (int s = 0; s < nOfStreams; ++s) {
+            stats->stream[s].framesShed = scheduler.shed_count(s);
+            channels[s]->bcQueue.report(stats->stream[s].bcQueue);
+            stats->stream[s].abQueue.superseded = channels[s]->abQueue.superseded_count();
+        }
+        monitor.sample(stats->process[PROCESS_B], ++rounds);
+        perfCounters.sample(stats->process[PROCESS_B].perf, rounds);
+        mutexStats.unlock();
         
 
-        //operate on array to copy to shmem
-        int facesArray[result.size()];
-        std::copy(result.begin(), result.end(), facesArray);
- 
-        mutexFaces.lock();
+        for (int s : processed) {
+            StreamChannel & channel = *channels[s];
+            const std::vector<int> & result = channel.faces;
 
-        //copy all found faces into region
-        memcpy(facesRegion.get_address(), facesArray, sizeof(facesArray));
+            //operate on array to copy to shmem
+            int facesArray[result.size()];
+            std::copy(result.begin(), result.end(), facesArray);
 
+            //a blocking queue keeps the faces C hasn't taken yet, B waits until C took them
+            if(SYNC_BC)
+                channel.bcQueue.wait_for_room();
+ 
+            channel.mutexFaces.lock();
 
-        //if synchro with C is enabled (it's recommended) than the C will wait until B processes the frame and put detected faces
-        //into shmem, which happens here
-        if(SYNC_BC)
-            bc_mq.send(&whatever, sizeof(whatever), 0);
+            //copy all found faces into region, after the size of the frame they were found in and the frame they belong to
+            channel.facesSize.sequence = channel.frameSequence;
+            memcpy(channel.facesRegion.get_address(), &channel.facesSize, sizeof(channel.facesSize));
+            memcpy((unsigned char*)channel.facesRegion.get_address() + sizeof(channel.facesSize), facesArray, sizeof(facesArray));
 
-        mutexFaces.unlock();
 
+            //if synchro with C is enabled (it's recommended) than the C will wait until B processes the frame and put detected faces
+            //into shmem, which happens here; the policy of the queue decides what happens when C falls behind, while C
+            //is down (restarted by D) B goes on without it
+            if(SYNC_BC)
+                channel.bcQueue.push(FrameTicket{channel.frameSequence, channel.captureTime});
+
+            channel.mutexFaces.unlock();
+        }
     }
+    resolution_listener.join();
+    detector_listener.join();
+    queue_listener.join();
     return 0;
 }
@@ -1,9 +1,20 @@
 // This process is responsible for receiving frames from the camera sent by process A,
 // receiving coordinates of all faces in the picture from process B, applying censure to them
-// and drawing the resulting picture onto the screen.
+// and drawing the resulting picture onto the screen. Every stream is censured in its own thread and shown in its own window.
 // This process can receive requests to change the censure mode from process D, which is responsible for the UI.
 
 #include "names.hpp"
+#include "ipc.hpp"
+#include "RobustMutex.hpp"
+#include "FrameBuffer.hpp"
+#include "FrameFormat.hpp"
+#include "BlurDrawer.hpp"
+#include "StageQueue.hpp"
+#include "stats.hpp"
+#include "ThreadBudget.hpp"
+#include "realtime.hpp"
+#include "PerfCounters.hpp"
+#include "soak.hpp"
 
 
 
@@ -14,17 +25,19 @@
 #include <opencv2/imgproc.hpp>
 
 #include <boost/interprocess/managed_shared_memory.hpp>
-#include <boost/interprocess/sync/named_mutex.hpp>
 #include <boost/interprocess/shared_memory_object.hpp>
 #include <boost/interprocess/mapped_region.hpp>
 #include <boost/interprocess/allocators/allocator.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/program_options.hpp>
 
 #include <vector>
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
 
 #include <sys/times.h>
@@ -51,149 +64,254 @@ void handleSIGINT(int sig)
     exit(0);
 }
 
-class BlurDrawer {
-private:
-    cv::Mat image;
-    std::vector<cv::Rect> face_list;
-    int mode;//blur mode
-    std::mutex mode_mutex;
+// responsible for receiving information about censure mode change from the UI
+// meant to run in a helper thread, since the receive() method is a blocking operation
+void wait_for_mode_change(std::vector<std::unique_ptr<BlurDrawer>> & drawers){
+
+    message_queue mq
+            (open_only       
+            ,CENSURE_MODE_Q_NAME  
+            );
+
+    unsigned int priority;
+    std::size_t recvd_size;
+    int new_mode;
 
-    static const int DEFAULT_MODE = 0;
+    while(true){
+        mq.receive(&new_mode, sizeof(new_mode), recvd_size, priority);
+        for (auto & drawer : drawers)
+            drawer->set_mode(new_mode);
+      }
+}
 
-public:
-    BlurDrawer(cv::Mat input_image, std::vector<cv::Rect> list, int x);
 
-    cv::Mat draw();
+// IPC objects of a single stream, all of them are created by A and B, the frame format is read from the frame buffer
+struct StreamChannel {
 
-    int get_mode(){
-        mode_mutex.lock();
-        int copy = mode;
-        mode_mutex.unlock();
-        return copy;
-    }
-    void set_mode(int new_mode){
-        mode_mutex.lock();
-        mode = new_mode;
-        mode_mutex.unlock();
-    }
+    //a ticket for every frame whose faces B put into the faces shmem
+    StageQueue bcQueue;
 
-    void set_draw_info(cv::Mat input_image, std::vector<cv::Rect> list) {
-        face_list = std::move(list);
-        image = input_image.clone();
+    //opening faces shmem
+    shared_memory_object facesShmem;
+    RobustMutex mutexBC;
+    mapped_region facesRegion;
 
+    //opening frame shmem
+    FrameBuffer regionFrame;
+    RobustMutex mutexFrame;
+
+    int stream;
+    //format of the frames in regionFrame, read from the frame buffer
+    FrameFormat format;
+    cv::Mat frame;
+
+    explicit StreamChannel(int stream) :
+        bcQueue(open_only, streamName(BC_SYNC_Q_NAME, stream).c_str()),
+        facesShmem(open_only, streamName(FACES_SHMEM_NAME, stream).c_str(), read_only),
+        mutexBC(open_only, streamName(FACES_MUTEX_NAME, stream).c_str()),
+        facesRegion(facesShmem, read_only),
+        regionFrame(open_only, streamName(FRAME_SHMEM_NAME, stream).c_str(), read_only),
+        mutexFrame(open_only, streamName(FRAME_MUTEX_NAME, stream).c_str()),
+        stream(stream),
+        format()
+    {
     }
-    BlurDrawer(){
-        mode = DEFAULT_MODE;
+
+    //view of the frame in shmem, rebuilt when A publishes frames of another format; the caller holds mutexFrame
+    const cv::Mat & current_frame() {
+        const FrameFormat & published = frame_header(regionFrame.get_address())->format;
+        if (published.version != format.version) {
+            if (format.version != 0)
+                std::cout << "Stream " << stream << ": frame format changed to " << published.cols << "x" << published.rows
+                          << " " << pixel_format_name(published.pixelFormat) << std::endl;
+            format = published;
+            frame = format.view(frame_pixels(regionFrame.get_address()));
+        }
+        return frame;
     }
 };
 
+// censured frame waiting to be shown, windows can only be drawn from the main thread
+struct DisplaySlot {
+    std::mutex mutex;
+    cv::Mat image;
+    int64_t imageCaptureTime;
+    std::chrono::steady_clock::time_point renderStart;
+    double convertMs;
+    bool fresh = false;
+};
+
 
-BlurDrawer::BlurDrawer(cv::Mat input_image, std::vector<cv::Rect> list, int x) {
+// censure loop of a single stream, meant to run in its own thread
+void censure_stream(StreamChannel & channel, BlurDrawer & drawer, DisplaySlot & slot, PipelineStats * stats, RobustMutex & mutexStats) {
 
-    face_list = std::move(list);
-    image = input_image.clone();
-    mode = x;
-}
+    //each censure thread is a worker D may give a deadline reservation
+    mutexStats.lock();
+    RealtimeMonitor::add_worker(stats->process[PROCESS_C]);
+    mutexStats.unlock();
 
-cv::Mat BlurDrawer::draw() {
-    //fill face rect
-     if( mode == 0) {
+    //sequence of the frame rendered last, tickets of older frames queued by B are skipped
+    uint64_t renderedSequence = 0;
 
-         cv::Scalar color(0, 0, 0);//red
-         
-         int frame_thickness = -1;//fill
-         for (const auto &r : face_list) {
+    while(true) {
 
-            cv::rectangle(image, r, color, frame_thickness);   
+        //if synchro with B is enabled (it's recommended) than the C will wait until B processes the frame and put detected faces
+        //into shmem; the ticket names the frame B detected the faces in and when it was captured
+        FrameTicket ticket = {0, 0};
+        if(SYNC_BC) {
+            ticket = channel.bcQueue.pop_newer(renderedSequence);
+            renderedSequence = ticket.sequence;
+        }
 
-         }
-         //add gaussian blur on face rect
-     } else if (mode == 1) {
-         for (const auto &r : face_list) {
-             //increasing sigma X val strengthen blur
-             cv::GaussianBlur(image(r), image(r), cv::Size(0,0), 11);
-         }
-     }
-    return image;
+        channel.mutexBC.lock();
 
-}
+        //the faces start with the size of the frame B found them in, then the first element put into array is size
+        //of this array and then we have 4 int values for every face which define rectangle containing detected face
+        FacesHeader facesHeader;
+        memcpy(&facesHeader, channel.facesRegion.get_address(), sizeof(facesHeader));
+        //B already wrote the faces of a newer frame, whose ticket follows
+        if(SYNC_BC && facesHeader.sequence != ticket.sequence) {
+            channel.mutexBC.unlock();
+            continue;
+        }
+        unsigned char * facesData = (unsigned char*)channel.facesRegion.get_address() + sizeof(facesHeader);
+        int sizeOfArray;
+        memcpy(&sizeOfArray, facesData, sizeof(int));
 
+        //n of faces read, create and copy array from shmem
+        int faces[sizeOfArray+1];
 
-// responsible for receiving information about censure mode change from the UI
-// meant to run in a helper thread, since the receive() method is a blocking operation
-void wait_for_mode_change(BlurDrawer & drawer){
+        memcpy(faces, facesData, sizeof(faces));
+        channel.mutexBC.unlock();
 
-    message_queue mq
-            (open_only       
-            ,CENSURE_MODE_Q_NAME  
-            );
+        //create frame based on data in shared memory
+        channel.mutexFrame.lock();
+        const FrameSlotHeader * header = frame_header(channel.regionFrame.get_address());
+        if(!SYNC_BC)
+            ticket = FrameTicket{header->sequence, header->captureTime};
+        //A published newer frames since the one of the ticket, the frame is still there only if none of its tiles changed
+        bool overwritten = header->sequence != ticket.sequence
+                           && (header->sequence < ticket.sequence || tiles_changed_since(header, ticket.sequence) > 0);
+        if(overwritten) {
+            channel.mutexFrame.unlock();
+            mutexStats.lock();
+            ++stats->stream[channel.stream].framesOverwritten;
+            mutexStats.unlock();
+            continue;
+        }
+        const cv::Mat & img = channel.current_frame();
+        FrameFormat format = channel.format;
 
-    unsigned int priority;
-    std::size_t recvd_size;
-    int new_mode;
+        //faces found in a scaled frame (native frames are detected at the detector input size) or before the resolution
+        //changed are scaled to this frame
+        double scaleX = facesHeader.cols > 0 ? (double)format.cols / facesHeader.cols : 1.0;
+        double scaleY = facesHeader.rows > 0 ? (double)format.rows / facesHeader.rows : 1.0;
 
-    while(true){
-        mq.receive(&new_mode, sizeof(new_mode), recvd_size, priority);
-        drawer.set_mode(new_mode);
-      }
+        //render time is measured from the moment faces are known, waiting for B is not included
+        auto renderStart = std::chrono::steady_clock::now();
+        
+        // for every face construct a rectangle and put it into vector used then to draw
+        std::vector<cv::Rect> list;
+        for(int i = 1; i <= sizeOfArray; i += 4) {
+
+            list.push_back(scaled_face(cv::Rect(faces[i], faces[i+1], faces[i+2], faces[i+3]), scaleX, scaleY, format.size()));
+        }
+
+
+        //native frames are converted to BGR here, once, instead of being copied; A rewrites the tiles of the slot in
+        //place, so the frame is converted or copied before mutexFrame is released
+        auto convertStart = std::chrono::steady_clock::now();
+        drawer.set_draw_info(img, list, format.pixelFormat);
+        std::chrono::duration<double, std::milli> convertTime = std::chrono::steady_clock::now() - convertStart;
+        channel.mutexFrame.unlock();
+
+        cv::Mat image = drawer.draw();
+
+        //hand the frame with censure over to the main thread, a frame not shown yet is replaced with the newer one
+        slot.mutex.lock();
+        slot.image = image;
+        slot.imageCaptureTime = ticket.captureTime;
+        slot.renderStart = renderStart;
+        slot.convertMs = convertTime.count();
+        slot.fresh = true;
+        slot.mutex.unlock();
+    }
 }
 
 
 
-int main() {
+// every stream is displayed in its own window
+int main(int argc, char **argv) {
 
     //here we define a signal handler and start CPU time tracking to display average CPU usage of the process at the exit
     signal(SIGINT, handleSIGINT);
+    ThreadBudget::catch_signal();
     realStart = times(&cpuStart);
 
-    BlurDrawer drawer;
+    int nOfStreams;
+
+    namespace po = boost::program_options;
+    po::options_description options("Process C options");
+    options.add_options()
+        ("streams", po::value<int>(&nOfStreams)->default_value(1), "number of video streams")
+        ("mlock", "lock the memory of the process and prefault shared memory")
+        ("perf", "count cycles, instructions, cache and branch misses and context switches per frame")
+        ("soak", "measure wake-up latencies for a soak run")
+        ("reattach", "C only opens IPC objects, accepted for a restart by D");
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, options), vm);
+    po::notify(vm);
+    nOfStreams = std::max(1, std::min(nOfStreams, MAX_STREAMS));
+
+    //opened before any thread is started, so the counters include censure threads and the OpenCV thread pool
+    PerfCounters perfCounters(vm.count("perf") > 0);
+
+    //blurring runs in the OpenCV thread pool, sized to the cores C is allowed to run on
+    ThreadBudget threadBudget("C");
+
+    std::vector<std::unique_ptr<BlurDrawer>> drawers;
+    for (int i = 0; i < nOfStreams; ++i)
+        drawers.emplace_back(new BlurDrawer());
     //thread which listens for censure mode's change
-    std::thread mode_listener(wait_for_mode_change, std::ref(drawer));
- 
-    std::vector<cv::Mat> framesBuffer;
-    std::vector<unsigned int> frameNumber;
+    std::thread mode_listener(wait_for_mode_change, std::ref(drawers));
 
 
     // =================================
     // INITIAL IPC OBJECTS SETUP BEGIN
 
-    //removers make sure that IPC resource does get removed and we will not have errors creating a new ones
+    std::vector<std::unique_ptr<StreamChannel>> channels;
+    for (int i = 0; i < nOfStreams; ++i)
+        channels.emplace_back(new StreamChannel(i));
 
+    //render time and end-to-end latency are reported to D and to the rate controller in A
+    RobustMutex mutexStats(open_only, STATS_MUTEX_NAME);
+    shared_memory_object statsShmem(open_only, STATS_SHMEM_NAME, read_write);
+    mapped_region statsRegion(statsShmem, read_write);
+    PipelineStats * stats = static_cast<PipelineStats*>(statsRegion.get_address());
 
-    message_queue bc_mq
-         (open_only               //only create
-         ,BC_SYNC_Q_NAME    //name
-         );
-
-    //opening faces shmem
-    shared_memory_object facesShmem(open_only, FACES_SHMEM_NAME, read_only);
-    named_mutex mutexBC(boost::interprocess::open_only, FACES_MUTEX_NAME);
-    mapped_region facesRegion(facesShmem, read_only);
-    
-    //opening frame shmem
-
-    shared_memory_object frameShmem(open_only, FRAME_SHMEM_NAME, read_only);
-    mapped_region regionFrame(frameShmem, read_only);
-    named_mutex mutexFrame(open_only, FRAME_MUTEX_NAME);
-
-    //opening framesize shmem
+    // INITIAL IPC OBJECTS SETUP END
+    // =================================
 
-    named_mutex mutexFramesize(open_only, FRAMESIZE_MUTEX);
-    shared_memory_object framesizeInfo(open_only, FRAMESIZE_SHMEM, read_only);
-    mapped_region framesizeRegion(framesizeInfo, read_only);
-    long framesize[3];
-   
-    //read framesize
-    mutexFramesize.lock();
-    memcpy(framesize, framesizeRegion.get_address(), sizeof(framesize));
-    mutexFramesize.unlock();
+    //counts deadline overruns, optionally keeps the process and its shared memory resident
+    RealtimeMonitor monitor;
+    if (vm.count("mlock")) {
+        for (auto & channel : channels) {
+            RealtimeMonitor::prefault(channel->regionFrame.get_address(), channel->regionFrame.get_size());
+            RealtimeMonitor::prefault(channel->facesRegion.get_address(), channel->facesRegion.get_size());
+        }
+        RealtimeMonitor::prefault(statsRegion.get_address(), statsRegion.get_size());
+        bool locked = monitor.lock_memory();
+        mutexStats.lock();
+        stats->process[PROCESS_C].memoryLocked = locked;
+        mutexStats.unlock();
+    }
 
-    int64_t imageProcessedTime, imageCaptureTime;
+    //wake-up jitter of C is measured for the whole soak run
+    std::unique_ptr<WakeupProbe> wakeupProbe;
+    if (vm.count("soak"))
+        wakeupProbe.reset(new WakeupProbe(&stats->process[PROCESS_C], mutexStats));
 
-    //those vars are used only for receiving info from queue and will not be actively used
-    unsigned int priority;
-    size_t recvd_size;
-    char whatever;
+    int64_t imageProcessedTime;
 
     //file to save frames processing times to
     std::ofstream timeFile;
@@ -201,61 +319,72 @@ int main() {
         timeFile.open("perf_test/times.txt", std::ios_base::out);
     }
 
+    std::vector<std::unique_ptr<DisplaySlot>> slots;
+    std::vector<std::string> windowNames;
+    std::vector<std::thread> censureThreads;
+    //the workers of C are the censure threads and this display loop
+    mutexStats.lock();
+    RealtimeMonitor::clear_workers(stats->process[PROCESS_C]);
+    RealtimeMonitor::add_worker(stats->process[PROCESS_C]);
+    mutexStats.unlock();
+    for (int i = 0; i < nOfStreams; ++i) {
+        slots.emplace_back(new DisplaySlot());
+        windowNames.push_back(nOfStreams == 1 ? "Real-Time Face Censure" : "Real-Time Face Censure " + std::to_string(i));
+        censureThreads.emplace_back(censure_stream, std::ref(*channels[i]), std::ref(*drawers[i]), std::ref(*slots[i]), stats, std::ref(mutexStats));
+    }
+    //time the last frame of every stream was shown, the longest gap is reported as a stall
+    std::vector<std::chrono::steady_clock::time_point> lastDisplayed(nOfStreams);
 
-    while(true) {
-
-        //create frame based on data in shared memory
-        mutexFrame.lock();
-        memcpy(&imageCaptureTime, regionFrame.get_address(), sizeof(int64_t));
-        cv::Mat img(framesize[0], framesize[1],
-                            framesize[2],
-                            (unsigned char*)(regionFrame.get_address()) + sizeof(int64_t),
-                            cv::Mat::AUTO_STEP);
-
-        mutexFrame.unlock();
-        
-        //if synchro with B is enabled (it's recommended) than the C will wait until B processes the frame and put detected faces
-        //into shmem
-        if(SYNC_BC)
-            bc_mq.receive(&whatever, sizeof(whatever), recvd_size, priority);
-
-        mutexBC.lock();
-
-        //first element put into array is size of this array and then we have 4 int values for every face which
-        //define rectangle containing detected face
-        int sizeOfArray;
-        memcpy(&sizeOfArray, facesRegion.get_address(), sizeof(int));
-
-        //n of faces read, create and copy array from shmem
-        int faces[sizeOfArray+1];
-
-        memcpy(faces, facesRegion.get_address(), sizeof(faces));
-        mutexBC.unlock();
-        
-        // for every face construct a rectangle and put it into vector used then to draw
-        std::vector<cv::Rect> list;
-        for(int i = 1; i <= sizeOfArray; i += 4) {
-
-            cv::Rect temp(faces[i] , faces[i+1], faces[i+2], faces[i+3]);
-            list.push_back(temp);
-        }
-
-
-
-        drawer.set_draw_info(img, list);
-
-        cv::Mat image = drawer.draw();
 
-        
+    while(true) {
+        threadBudget.poll();
+
+        for (int i = 0; i < nOfStreams; ++i) {
+            DisplaySlot & slot = *slots[i];
+
+            slot.mutex.lock();
+            bool fresh = slot.fresh;
+            cv::Mat image = slot.image;
+            int64_t imageCaptureTime = slot.imageCaptureTime;
+            auto renderStart = slot.renderStart;
+            double convertMs = slot.convertMs;
+            slot.fresh = false;
+            slot.mutex.unlock();
+
+            if (!fresh)
+                continue;
        
-        //display the frame with censure
-        cv::imshow("Real-Time Face Censure", image);
-
-        imageProcessedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            //display the frame with censure
+            cv::imshow(windowNames[i], image);
+
+            imageProcessedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+            auto displayed = std::chrono::steady_clock::now();
+            std::chrono::duration<double, std::milli> renderTime = displayed - renderStart;
+            std::chrono::duration<double, std::milli> frameGap = displayed - lastDisplayed[i];
+            bool firstFrame = lastDisplayed[i].time_since_epoch().count() == 0;
+            lastDisplayed[i] = displayed;
+
+            mutexStats.lock();
+            updateAverage(stats->stream[i].renderMs, renderTime.count());
+            updateAverage(stats->stream[i].convertMs, convertMs);
+            updateAverage(stats->stream[i].latencyMs, imageProcessedTime - imageCaptureTime);
+            recordLatency(stats, imageProcessedTime - imageCaptureTime);
+            ++stats->stream[i].framesDisplayed;
+            stats->stream[i].bcQueue.superseded = channels[i]->bcQueue.superseded_count();
+            stats->stream[i].lastCaptureMs = imageCaptureTime;
+            if (!firstFrame)
+                stats->stream[i].maxFrameGapMs = std::max(stats->stream[i].maxFrameGapMs, frameGap.count());
+            int64_t framesOfAllStreams = 0;
+            for (int s = 0; s < nOfStreams; ++s)
+                framesOfAllStreams += stats->stream[s].framesDisplayed;
+            monitor.sample(stats->process[PROCESS_C], framesOfAllStreams);
+            perfCounters.sample(stats->process[PROCESS_C].perf, framesOfAllStreams);
+            mutexStats.unlock();
         
-        if(SAVE_PROCESSING_TIME) {        
-            timeFile << imageProcessedTime - imageCaptureTime << std::endl;
-            timeFile.flush();
+            if(SAVE_PROCESSING_TIME) {        
+                timeFile << imageProcessedTime - imageCaptureTime << std::endl;
+                timeFile.flush();
+            }
         }
 
         //needed but ignored, without it the window will disappear
@@ -263,6 +392,8 @@ int main() {
         
     }
 
+    for (auto & t : censureThreads)
+        t.join();
     mode_listener.join();
 
     return 0;
@@ -9,15 +9,58 @@
 #include <ctime>
 
 #include <sys/times.h>
+#include <sys/statvfs.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <poll.h>
 #include <signal.h>
 #include <sched.h>
 #include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <iomanip>
+#include <cmath>
 
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/program_options.hpp>
 #include "names.hpp"
+#include "stats.hpp"
+#include "RobustMutex.hpp"
+#include "FrameBuffer.hpp"
+#include "realtime.hpp"
+#include "PixelFormat.hpp"
+#include "StageQueue.hpp"
 
 
 #define N_OF_SUBPROCESSES 3
+// fps cap of A when a profile doesn't set one, same as FrameSender::DEFAULT_FPS
+#define FPS_DEFAULT_CAP 30
+#define AUTOTUNE_PROFILE "autotune.profile"
+// seconds of a soak run before the measurements start, covers model loading and the rate controller settling
+#define SOAK_WARMUP_S 10
+// how often the progress of a soak run is printed
+#define SOAK_REPORT_PERIOD_S 60
+// the supervisor checks the children at least this often (exits are noticed right away through pidfds)
+#define SUPERVISOR_PERIOD_MS 100
+// a child crashing more often than this within the window isn't restarted any more
+#define SUPERVISOR_MAX_RESTARTS 5
+#define SUPERVISOR_RESTART_WINDOW_S 60
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
 
 
 using namespace std;
@@ -38,63 +81,116 @@ void printAffinity(int pid) {
     cout << endl;
 }
 
-void printScheduling(int pid) {
-    int result = sched_getscheduler(pid);
-    if(result == -1) {
-        cerr << "Error: could not get scheduler" << endl;
-        return;
-    }
-    string toPrint;
-    switch (result) {
+string schedulingName(int policy) {
+    switch (policy) {
         case SCHED_OTHER:
-            toPrint = "Standard round-robin";
-            break;
+            return "Standard round-robin";
         case SCHED_BATCH:
-            toPrint = "Batch";
-            break;
+            return "Batch";
         case SCHED_IDLE:
-            toPrint = "Idle job";
-            break;
+            return "Idle job";
         case SCHED_FIFO:
-            toPrint = "FIFO";
-            break;
+            return "FIFO";
         case SCHED_RR:
-            toPrint = "Round-robin with priority";
-            break;
+            return "Round-robin with priority";
+        case SCHED_DEADLINE:
+            return "Deadline";
         default:
-            toPrint = "Error: unknown scheduling policy";
+            return "Error: unknown scheduling policy";
     }
-    cout << "PID: " << pid << "\t scheduling: " << toPrint << endl;
-    
 }
 
-void setScheduling(int pid, int policy, int priority = 0) {
-        sched_param parameter;
-        parameter.sched_priority = priority;
-        if(sched_setscheduler(pid, policy, &parameter) == -1) {
+// the work runs in the threads of a process, not only in its main thread: shows how many threads run in each policy
+void printScheduling(int pid) {
+    map<string, int> threads;
+    for(pid_t tid : process_threads(pid)) {
+        DeadlineAttr attr;
+        if(!thread_scheduling(tid, attr))
+            continue;
+        string name = schedulingName(attr.sched_policy);
+        if(attr.sched_policy == SCHED_FIFO || attr.sched_policy == SCHED_RR)
+            name += " " + to_string(attr.sched_priority);
+        threads[name]++;
+    }
+    if(threads.empty()) {
+        cerr << "Error: could not get scheduler" << endl;
+        return;
+    }
+    cout << "PID: " << pid << "	 scheduling:";
+    for(const auto & policy : threads)
+        cout << " " << policy.first << " (" << policy.second << (policy.second == 1 ? " thread)" : " threads)");
+    cout << endl;
+}
+
+// the policy applies to every thread of the process, see set_policy(); worker threads under SCHED_DEADLINE give up
+// their reservation
+bool setScheduling(int pid, int policy, int priority = 0) {
+        int reserved = 0;
+        for(pid_t tid : process_threads(pid)) {
+            DeadlineAttr attr;
+            if(thread_scheduling(tid, attr) && attr.sched_policy == SCHED_DEADLINE)
+                ++reserved;
+        }
+        if(!set_policy(pid, policy, priority)) {
             cerr << "Error: could not set scheduler" << endl;
+            return false;
         }
+        if(reserved > 0)
+            cout << "SCHED_DEADLINE reservations of " << reserved << " threads released" << endl;
+        return true;
 }
 
-void setAffinity(int pid, vector<int> cpus) {
+bool setAffinity(int pid, vector<int> cpus) {
     cpu_set_t mask;
     CPU_ZERO(&mask);
 
     for( int cpu : cpus ){
         if(cpu < 0 || cpu >= sysconf(_SC_NPROCESSORS_ONLN)) {
             cerr << "Error: CPU number can't be negative or equal/greater than number of available CPUs" << endl;    
-            return;
+            return false;
         }
         CPU_SET(cpu, &mask);
     }
 
     if(sched_setaffinity(pid, sizeof(cpu_set_t), &mask) != 0) {
         cerr << "Error: could not set affinity" << endl;
+        return false;
     }
+    //only the main thread got the new mask, the process passes it to its other threads and resizes its thread pool
+    kill(pid, AFFINITY_CHANGED_SIGNAL);
+    return true;
     
 }
 
-void changeAffinityMenu(int childrenPids[]) {
+// frame buffers are read by B and C, so their pages belong on the NUMA node where most of the cores of B and C are.
+// The node is sent to A, which owns the buffers, only when it changes and the machine has more than one node.
+void placeFrameBuffers(atomic<int> childrenPids[], boost::interprocess::message_queue & numa_mq) {
+    static int currentNode = -1;
+    map<int, int> nodes = cpu_nodes();
+    set<int> nodeIds;
+    for(const auto & cpu : nodes)
+        nodeIds.insert(cpu.second);
+    if(nodeIds.size() < 2)
+        return;
+
+    vector<int> consumerCpus;
+    for(int i = 1; i < N_OF_SUBPROCESSES; ++i) {
+        cpu_set_t mask;
+        if(sched_getaffinity(childrenPids[i], sizeof(cpu_set_t), &mask) != 0)
+            continue;
+        for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if(CPU_ISSET(cpu, &mask))
+                consumerCpus.push_back(cpu);
+    }
+    int node = majority_node(consumerCpus);
+    if(node < 0 || node == currentNode)
+        return;
+    numa_mq.send(&node, sizeof(node), 0);
+    currentNode = node;
+    cout << "Frame buffers are moved to NUMA node " << node << ", local to processes B and C" << endl;
+}
+
+void changeAffinityMenu(atomic<int> childrenPids[]) {
     //system("clear");
     
     char letter = 'A';
@@ -140,7 +236,51 @@ void changeAffinityMenu(int childrenPids[]) {
 
 }
 
-void changeSchedulingMenu(int childrenPids[]) {
+// SCHED_DEADLINE reservations for the worker threads of a process derived from its measured cost: the period is the
+// frame period of the fastest stream and the deadline is the end of the period. The cost per frame of a worker is
+// the cost of the process per frame split by the share of the process CPU time the worker used, times the number of
+// workers since each of them handles only the frames of its stream; the runtime is that cost with a margin.
+bool setDeadlineFromStats(int pid, int process, PipelineStats * stats, RobustMutex & mutex) {
+    mutex.lock();
+    double fps = 0.0;
+    for(int i = 0; i < stats->streams; ++i)
+        fps = max(fps, stats->stream[i].publishFps);
+    double costMs = stats->process[process].frameCpuMs;
+    vector<pid_t> workers(stats->process[process].workerTids, stats->process[process].workerTids + stats->process[process].workerThreads);
+    mutex.unlock();
+
+    if(fps <= 0.0 || costMs <= 0.0 || workers.empty()) {
+        cerr << "Error: the cost of the process wasn't measured yet, let the pipeline run for a while" << endl;
+        return false;
+    }
+    double periodMs = 1000.0 / fps;
+    double processTicks = task_cpu_ticks(pid);
+    vector<pid_t> threads;
+    vector<double> runtimesMs;
+    bool fits = true;
+    for(pid_t tid : workers) {
+        double ticks = task_cpu_ticks(pid, tid);
+        //a worker of a stream that ended is gone
+        if(ticks < 0 || processTicks <= 0)
+            continue;
+        double threadCostMs = costMs * workers.size() * ticks / processTicks;
+        double runtimeMs = max(DEADLINE_MIN_RUNTIME_MS, min(threadCostMs * DEADLINE_RUNTIME_MARGIN, 0.95 * periodMs));
+        fits = fits && threadCostMs * DEADLINE_RUNTIME_MARGIN <= runtimeMs;
+        threads.push_back(tid);
+        runtimesMs.push_back(runtimeMs);
+        cout << "SCHED_DEADLINE for thread " << tid << ": runtime " << runtimeMs << " ms, deadline " << periodMs << " ms, period "
+             << periodMs << " ms (measured cost " << threadCostMs << " ms per frame)" << endl;
+    }
+    if(threads.empty()) {
+        cerr << "Error: no worker thread of the process is running" << endl;
+        return false;
+    }
+    if(!fits)
+        cout << "Warning: the measured cost with margin doesn't fit into the frame period, expect deadline overruns" << endl;
+    return set_deadline(threads, runtimesMs, periodMs, periodMs);
+}
+
+void changeSchedulingMenu(atomic<int> childrenPids[], PipelineStats * stats, RobustMutex & mutexStats) {
     //system("clear");
     
     char letter = 'A';
@@ -157,13 +297,14 @@ void changeSchedulingMenu(int childrenPids[]) {
         cout << "Invalid option, please select 1-3" << endl;
     }
     cin.ignore();
-    int pidToChange;
+    int pidToChange, processToChange;
     switch (option)
     {
         case '1':
         case '2':
         case '3':
-            pidToChange = childrenPids[(int)option - (int)'0' - 1];
+            processToChange = (int)option - (int)'0' - 1;
+            pidToChange = childrenPids[processToChange];
             break;
         default:
             cout << "Invalid option, please select 1-3" << endl;
@@ -174,11 +315,12 @@ void changeSchedulingMenu(int childrenPids[]) {
 
     int choosenPolicy = -1, priority = 0;
     cout << endl << "Choose scheduling option: " << endl << "1. SCHED_OTHER" << endl << "2. SCHED_BATCH"
-        << endl << "3. SCHED_IDLE" << endl << "4. SCHED_FIFO" << endl << "5. SCHED_RR" << endl;
+        << endl << "3. SCHED_IDLE" << endl << "4. SCHED_FIFO" << endl << "5. SCHED_RR" << endl
+        << "6. SCHED_DEADLINE (from measured cost)" << endl;
     
-    while(!(cin >> option) || (int)(option - '0') < 1 || (int)(option - '0') > 5) {
+    while(!(cin >> option) || (int)(option - '0') < 1 || (int)(option - '0') > 6) {
         cin.ignore();
-        cout << "Invalid option, please select 1-3" << endl;
+        cout << "Invalid option, please select 1-6" << endl;
     }
     cin.ignore();
     switch (option)
@@ -211,8 +353,12 @@ void changeSchedulingMenu(int childrenPids[]) {
                 cout << "Please input valid integer" << endl;
             }
             break;
+        case '6':
+            //deadline parameters are set through sched_setattr for the worker threads of the process
+            setDeadlineFromStats(pidToChange, processToChange, stats, mutexStats);
+            return;
         default:
-            cout << "Invalid option, please select 1-5" << endl;
+            cout << "Invalid option, please select 1-6" << endl;
             break;
     }
 
@@ -236,6 +382,127 @@ void changeCensureMenu(boost::interprocess::message_queue & mq){
     mq.send(&mode, sizeof(mode), 0);
 }
 
+void changeLatencySloMenu(boost::interprocess::message_queue & mq){
+    cout << "Enter end-to-end latency target in ms: " << endl;
+    int slo;
+    while(!(cin >> slo) || slo <= 0) {
+        cin.clear();
+        cin.ignore();
+        cout << "Please input valid positive integer" << endl;
+    }
+    mq.send(&slo, sizeof(slo), 0);
+}
+
+void changeResolutionMenu(boost::interprocess::message_queue & mq){
+    cout << "Enter detector input size: 160, 224, 300, 400 or 480 to force it, 0 for automatic choice" << endl;
+    int size;
+    while(!(cin >> size) || (size != 0 && size != 160 && size != 224 && size != 300 && size != 400 && size != 480)) {
+        cin.clear();
+        cin.ignore();
+        cout << "Please input valid size" << endl;
+    }
+    mq.send(&size, sizeof(size), 0);
+}
+
+// the resolution is lowered to shed load of B and C, frames larger than the native resolution of a source don't fit
+// into its frame buffer and are refused by A
+void changeCaptureResolutionMenu(boost::interprocess::message_queue & mq){
+    cout << "Enter capture resolution as width and height (e.g. 640 480), 0 0 for the native resolution of the sources" << endl;
+    int size[2];
+    while(!(cin >> size[0] >> size[1]) || size[0] < 0 || size[1] < 0 || (size[0] == 0) != (size[1] == 0)) {
+        cin.clear();
+        cin.ignore(256, '\n');
+        cout << "Please input valid width and height" << endl;
+    }
+    mq.send(size, sizeof(size), 0);
+}
+
+// B loads the detector in the background and switches to it between frames, options that are not given stay as they are
+void swapDetectorMenu(boost::interprocess::message_queue & mq){
+    cout << "Enter detector options, e.g. --confidence 0.7 or --detector onnx --model models/face_ssd.onnx --precision fp16" << endl;
+    string request;
+    while(getline(cin, request) && request.empty());
+    if(request.size() >= DETECTOR_REQUEST_SIZE) {
+        cout << "Options too long, at most " << DETECTOR_REQUEST_SIZE - 1 << " characters" << endl;
+        return;
+    }
+    mq.send(request.c_str(), request.size() + 1, 0);
+}
+
+// the queues A -> B are handled by A and the queues B -> C by B, the policy applies to all streams
+void changeQueuePolicyMenu(boost::interprocess::message_queue & ab_mq, boost::interprocess::message_queue & bc_mq){
+    cout << "Enter queue (ab or bc) and policy: latest, block or every:<n>" << endl;
+    string queue, text;
+    QueuePolicy policy;
+    while(!(cin >> queue >> text) || (queue != "ab" && queue != "bc") || !parse_queue_policy(text, policy)) {
+        cin.clear();
+        cin.ignore(256, '\n');
+        cout << "Please input valid queue and policy, e.g. bc every:2" << endl;
+    }
+    (queue == "ab" ? ab_mq : bc_mq).send(&policy, sizeof(policy), 0);
+}
+
+void printQueue(const char * name, const QueueStats & q) {
+    cout << "\t queue " << name << " " << queue_policy_name(q.policy, q.nth) << ": pushed " << q.pushed << ", dropped "
+         << q.dropped << ", superseded " << q.superseded << ", occupancy " << q.occupancy << " (max " << q.maxOccupancy
+         << "), blocked " << q.blockedMs << " ms" << endl;
+}
+
+void printStats(PipelineStats * stats, RobustMutex & mutex) {
+    mutex.lock();
+    PipelineStats copy = *stats;
+    mutex.unlock();
+    cout << "A: latency target " << copy.latencySloMs << " ms" << endl
+         << "B: inference " << copy.inferenceMs << " ms at " << copy.inputSize << "x" << copy.inputSize
+         << ", batch of " << copy.batchSize << "/" << copy.streams << " streams";
+    if(copy.prepareMs > 0)
+        cout << ", native frames scaled and converted in " << copy.prepareMs << " ms";
+    cout << endl;
+    if(copy.detectorSwaps > 0)
+        cout << "B: detector swapped " << copy.detectorSwaps << " times, last one prepared in " << copy.swapPrepareMs << " ms, switched in "
+             << copy.swapSwitchMs << " ms, inference blip " << copy.swapBlipMs << " ms" << endl;
+    for(int i = 0; i < copy.streams; ++i) {
+        const StreamStats & s = copy.stream[i];
+        cout << "Stream " << i << ": A " << s.frameCols << "x" << s.frameRows << " " << pixel_format_name(s.pixelFormat) << " ("
+             << s.frameBytes / 1024 << " kB per frame";
+        //BGR frames of the same size for comparison
+        if(s.pixelFormat != PIXEL_BGR)
+            cout << ", " << (int64_t)s.frameCols * s.frameRows * 3 / 1024 << " kB in BGR";
+        cout << ") at " << s.publishFps << " fps, sent " << s.framesPublished;
+        //with deltas A writes only the changed tiles
+        if(s.writtenBytes < s.frameBytes)
+            cout << ", wrote " << (int64_t)s.writtenBytes / 1024 << " kB per frame (" << s.changedTiles * 100 << "% of tiles changed)";
+        cout << " | B processed " << s.framesDetected << ", shed " << s.framesShed;
+        if(s.framesGated > 0)
+            cout << ", gated " << s.framesGated;
+        cout << " | C " << (s.pixelFormat != PIXEL_BGR ? "conversion " : "copy ") << s.convertMs << " ms, render " << s.renderMs
+             << " ms, latency " << s.latencyMs << " ms, displayed " << s.framesDisplayed;
+        if(s.framesOverwritten > 0)
+            cout << ", overwritten " << s.framesOverwritten;
+        cout << endl;
+        printQueue("A->B", s.abQueue);
+        printQueue("B->C", s.bcQueue);
+    }
+    char letter = 'A';
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        const ProcessStats & p = copy.process[i];
+        cout << "Process " << (char)(letter+i) << ": " << p.frameCpuMs << " ms CPU per frame, page faults " << p.minorFaults
+             << " minor (" << p.minorFaultsPerSec << "/s) " << p.majorFaults << " major, deadline overruns " << p.deadlineOverruns
+             << (p.memoryLocked ? ", memory locked" : "") << endl;
+        if(p.restarts > 0)
+            cout << "\t restarted " << p.restarts << " times, last recovery took " << p.recoveryMs << " ms" << endl;
+        const PerfStats & perf = p.perf;
+        if(perf.state == PERF_DENIED)
+            cout << "\t performance counters not permitted (see /proc/sys/kernel/perf_event_paranoid)" << endl;
+        else if(perf.state != PERF_OFF) {
+            double cycles = perf.perFrame[PERF_CYCLES];
+            cout << "\t per frame: " << cycles / 1e6 << " Mcycles, IPC " << (cycles > 0 ? perf.perFrame[PERF_INSTRUCTIONS] / cycles : 0.0)
+                 << ", cache misses " << perf.perFrame[PERF_CACHE_MISSES] / 1e3 << "k, branch misses " << perf.perFrame[PERF_BRANCH_MISSES] / 1e3
+                 << "k, context switches " << perf.perFrame[PERF_CONTEXT_SWITCHES] << (perf.state == PERF_PARTIAL ? " (some counters unavailable)" : "") << endl;
+        }
+    }
+}
+
 void changeFpsMenu(boost::interprocess::message_queue & mq){
     cout << "Enter upper fps cap: " << endl;
     int fps;
@@ -247,9 +514,786 @@ void changeFpsMenu(boost::interprocess::message_queue & mq){
     mq.send(&fps, sizeof(fps), 0);
 }
 
+// =================================
+// SCHEDULING AUTOTUNER
+
+// complete scheduling setup of A, B and C, empty list of cores means all cores
+struct SchedulingConfig {
+    vector<int> cores[N_OF_SUBPROCESSES];
+    int policy[N_OF_SUBPROCESSES];
+    int priority[N_OF_SUBPROCESSES];
+    int fps;
+};
+
+string policyName(int policy) {
+    switch (policy) {
+        case SCHED_FIFO: return "fifo";
+        case SCHED_RR: return "rr";
+        case SCHED_BATCH: return "batch";
+        case SCHED_IDLE: return "idle";
+        default: return "other";
+    }
+}
+
+int policyFromName(const string & name) {
+    if(name == "fifo") return SCHED_FIFO;
+    if(name == "rr") return SCHED_RR;
+    if(name == "batch") return SCHED_BATCH;
+    if(name == "idle") return SCHED_IDLE;
+    return SCHED_OTHER;
+}
+
+string describeConfig(const SchedulingConfig & config) {
+    ostringstream os;
+    char letter = 'A';
+    os << "fps cap " << config.fps;
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        os << " | " << (char)(letter+i) << ": " << policyName(config.policy[i]);
+        if(config.policy[i] == SCHED_FIFO || config.policy[i] == SCHED_RR)
+            os << " " << config.priority[i];
+        os << " cores ";
+        if(config.cores[i].empty())
+            os << "all";
+        for(int core : config.cores[i])
+            os << core << " ";
+    }
+    return os.str();
+}
+
+// true when every thread of the process runs in the policy (and priority for FIFO and RR), so a measurement of the
+// configuration measures the policy and not just the one of the main thread
+bool policyApplied(int pid, int policy, int priority) {
+    vector<pid_t> threads = process_threads(pid);
+    for(pid_t tid : threads) {
+        DeadlineAttr attr;
+        if(!thread_scheduling(tid, attr))
+            continue;
+        bool prioritized = policy == SCHED_FIFO || policy == SCHED_RR;
+        if((int)attr.sched_policy != policy || (prioritized && (int)attr.sched_priority != priority)) {
+            cerr << "Error: thread " << tid << " of process " << pid << " runs in " << policyName(attr.sched_policy)
+                 << " instead of " << policyName(policy) << endl;
+            return false;
+        }
+    }
+    return !threads.empty();
+}
+
+bool applyConfig(const SchedulingConfig & config, atomic<int> childrenPids[], boost::interprocess::message_queue & fps_mq) {
+    int nOfProcs = sysconf(_SC_NPROCESSORS_ONLN);
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        vector<int> cores = config.cores[i];
+        if(cores.empty())
+            for(int core = 0; core < nOfProcs; ++core)
+                cores.push_back(core);
+        if(!setAffinity(childrenPids[i], cores) || !setScheduling(childrenPids[i], config.policy[i], config.priority[i])
+           || !policyApplied(childrenPids[i], config.policy[i], config.priority[i]))
+            return false;
+    }
+    fps_mq.send(&config.fps, sizeof(config.fps), 0);
+    return true;
+}
+
+// core layouts, scheduling policies and fps caps tried by the autotuner
+vector<SchedulingConfig> autotuneCandidates() {
+    int nOfProcs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    vector<vector<vector<int>>> layouts;
+    //every process on every core
+    layouts.push_back({{}, {}, {}});
+    if(nOfProcs >= 2) {
+        //A and C share the first core, B gets the rest
+        vector<int> rest;
+        for(int core = 1; core < nOfProcs; ++core)
+            rest.push_back(core);
+        layouts.push_back({{0}, rest, {0}});
+    }
+    if(nOfProcs >= 3) {
+        //A and C get a core each, B gets the rest
+        vector<int> rest;
+        for(int core = 2; core < nOfProcs; ++core)
+            rest.push_back(core);
+        layouts.push_back({{0}, rest, {1}});
+    }
+
+    //policy and priority of A, B and C
+    vector<vector<pair<int, int>>> policies = {
+        {{SCHED_OTHER, 0}, {SCHED_OTHER, 0}, {SCHED_OTHER, 0}},
+        {{SCHED_OTHER, 0}, {SCHED_FIFO, 50}, {SCHED_OTHER, 0}},
+        {{SCHED_FIFO, 40}, {SCHED_FIFO, 50}, {SCHED_FIFO, 60}},
+        {{SCHED_RR, 50}, {SCHED_RR, 50}, {SCHED_RR, 50}},
+    };
+
+    vector<int> fpsCaps = {15, 30, 60};
+
+    vector<SchedulingConfig> candidates;
+    for(const auto & layout : layouts)
+        for(const auto & policy : policies)
+            for(int fps : fpsCaps) {
+                SchedulingConfig config;
+                for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+                    config.cores[i] = layout[i];
+                    config.policy[i] = policy[i].first;
+                    config.priority[i] = policy[i].second;
+                }
+                config.fps = fps;
+                candidates.push_back(config);
+            }
+    return candidates;
+}
+
+struct AutotuneResult {
+    SchedulingConfig config;
+    int p99Ms;
+    double throughput;  // displayed frames per second, all streams together
+};
+
+// run the pipeline with the current configuration for a window and measure p99 latency and throughput
+AutotuneResult measureWindow(PipelineStats * stats, RobustMutex & mutex, int windowSeconds) {
+    static int64_t before[LATENCY_BUCKETS], after[LATENCY_BUCKETS];
+    int64_t displayedBefore = 0, displayedAfter = 0;
+
+    mutex.lock();
+    copy(stats->latencyHistogram, stats->latencyHistogram + LATENCY_BUCKETS, before);
+    for(int i = 0; i < stats->streams; ++i)
+        displayedBefore += stats->stream[i].framesDisplayed;
+    mutex.unlock();
+
+    sleep(windowSeconds);
+
+    mutex.lock();
+    copy(stats->latencyHistogram, stats->latencyHistogram + LATENCY_BUCKETS, after);
+    for(int i = 0; i < stats->streams; ++i)
+        displayedAfter += stats->stream[i].framesDisplayed;
+    mutex.unlock();
+
+    AutotuneResult result;
+    result.p99Ms = latencyPercentile(before, after, 0.99);
+    result.throughput = (double)(displayedAfter - displayedBefore) / windowSeconds;
+    return result;
+}
+
+// profile file: "fps N" line and "X policy P priority N cores ..." line for every process
+bool saveProfile(const SchedulingConfig & config, const string & path) {
+    ofstream file(path);
+    if(!file)
+        return false;
+    char letter = 'A';
+    file << "# scheduling profile of the face censure pipeline" << endl;
+    file << "fps " << config.fps << endl;
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        file << (char)(letter+i) << " policy " << policyName(config.policy[i]) << " priority " << config.priority[i] << " cores";
+        for(int core : config.cores[i])
+            file << " " << core;
+        file << endl;
+    }
+    return true;
+}
+
+bool loadProfile(const string & path, SchedulingConfig & config) {
+    ifstream file(path);
+    if(!file)
+        return false;
+    config.fps = FPS_DEFAULT_CAP;
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        config.cores[i].clear();
+        config.policy[i] = SCHED_OTHER;
+        config.priority[i] = 0;
+    }
+    string line;
+    while(getline(file, line)) {
+        istringstream is(line);
+        string key, word, policy;
+        if(!(is >> key) || key[0] == '#')
+            continue;
+        if(key == "fps") {
+            is >> config.fps;
+            continue;
+        }
+        int i = key[0] - 'A';
+        if(key.size() != 1 || i < 0 || i >= N_OF_SUBPROCESSES)
+            return false;
+        is >> word >> policy >> word >> config.priority[i] >> word;
+        config.policy[i] = policyFromName(policy);
+        int core;
+        while(is >> core)
+            config.cores[i].push_back(core);
+    }
+    return true;
+}
+
+// sweep all candidate configurations, apply the best one and save it as a profile.
+// The best configuration has the lowest p99 latency among the ones reaching at least 90% of the best throughput,
+// so a configuration can't win only by displaying fewer frames.
+void autotuneMenu(atomic<int> childrenPids[], boost::interprocess::message_queue & fps_mq, PipelineStats * stats, RobustMutex & mutex) {
+    cout << "Autotune runs every configuration for a fixed window, a replayed video source gives comparable results." << endl;
+    cout << "Enter measurement window in seconds:" << endl;
+    int windowSeconds;
+    while(!(cin >> windowSeconds) || windowSeconds <= 0) {
+        cin.clear();
+        cin.ignore();
+        cout << "Please input valid positive integer" << endl;
+    }
+    cin.ignore();
+    cout << "Enter file to save the profile to (empty for " << AUTOTUNE_PROFILE << "):" << endl;
+    string path;
+    getline(cin, path);
+    if(path.empty())
+        path = AUTOTUNE_PROFILE;
+
+    vector<SchedulingConfig> candidates = autotuneCandidates();
+    vector<AutotuneResult> results;
+    for(size_t c = 0; c < candidates.size(); ++c) {
+        cout << "[" << c+1 << "/" << candidates.size() << "] " << describeConfig(candidates[c]) << endl;
+        if(!applyConfig(candidates[c], childrenPids, fps_mq)) {
+            cout << "\t skipped, configuration could not be applied (real-time policies require sudo)" << endl;
+            continue;
+        }
+        //let the rate controller and queues settle before measuring
+        sleep(1);
+        AutotuneResult result = measureWindow(stats, mutex, windowSeconds);
+        //threads started during the window (e.g. a restarted child) must have run in the policy as well
+        bool applied = true;
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+            applied = applied && policyApplied(childrenPids[i], candidates[c].policy[i], candidates[c].priority[i]);
+        if(!applied) {
+            cout << "\t discarded, the policy did not reach all threads during the measurement" << endl;
+            continue;
+        }
+        result.config = candidates[c];
+        results.push_back(result);
+        cout << "\t p99 latency " << result.p99Ms << " ms, throughput " << result.throughput << " fps" << endl;
+    }
+
+    if(results.empty()) {
+        cout << "No configuration could be applied" << endl;
+        return;
+    }
+
+    double bestThroughput = 0.0;
+    for(const auto & r : results)
+        bestThroughput = max(bestThroughput, r.throughput);
+    const AutotuneResult * best = nullptr;
+    for(const auto & r : results)
+        if(r.throughput >= 0.9 * bestThroughput && (best == nullptr || r.p99Ms < best->p99Ms))
+            best = &r;
+
+    cout << "Best configuration: " << describeConfig(best->config) << endl
+         << "p99 latency " << best->p99Ms << " ms, throughput " << best->throughput << " fps" << endl;
+    if(!applyConfig(best->config, childrenPids, fps_mq)) {
+        cerr << "Error: the best configuration could not be applied again, profile not saved" << endl;
+        return;
+    }
+    if(saveProfile(best->config, path))
+        cout << "Profile saved to " << path << ", load it with D.out --profile " << path << endl;
+    else
+        cerr << "Error: could not save profile to " << path << endl;
+}
+
+// SCHEDULING AUTOTUNER END
+// =================================
+
+// =================================
+// SOAK RUN
+
+// limits a soak run has to stay within to pass
+struct SoakThresholds {
+    double maxWakeupUs;     // p99 wake-up latency of each process
+    double maxStallMs;      // longest time between two displayed frames of a stream
+    double maxDropRate;     // share of the frames published by A that were never displayed
+    double maxRssGrowthMb;  // growth of the resident memory of each process after the warm-up
+    double maxCpuDrift;     // change of the CPU usage of each process (percentage points) from the start to the end
+};
+
+struct ProcessSample {
+    long rssKb;
+    double cpuSeconds;
+};
+
+// resident memory and CPU time used so far by a process, read from /proc
+ProcessSample sampleProcess(int pid) {
+    ProcessSample sample = {0, 0.0};
+    ifstream statm("/proc/" + to_string(pid) + "/statm");
+    long size, resident;
+    if(statm >> size >> resident)
+        sample.rssKb = resident * (sysconf(_SC_PAGESIZE) / 1024);
+
+    ifstream stat("/proc/" + to_string(pid) + "/stat");
+    string line;
+    if(getline(stat, line) && line.rfind(')') != string::npos) {
+        //the command name may contain spaces, fields are counted from the state after it (field 3), utime and stime are 14 and 15
+        istringstream is(line.substr(line.rfind(')') + 2));
+        string field;
+        long ticks = 0;
+        for(int i = 3; i <= 15 && is >> field; ++i)
+            if(i >= 14)
+                ticks += stol(field);
+        sample.cpuSeconds = (double)ticks / sysconf(_SC_CLK_TCK);
+    }
+    return sample;
+}
+
+// kB of POSIX shared memory in use (frame buffers, stats, mutexes and queues)
+long shmUsedKb() {
+    struct statvfs fs;
+    if(statvfs("/dev/shm", &fs) != 0)
+        return 0;
+    return (long)((fs.f_blocks - fs.f_bfree) * fs.f_frsize / 1024);
+}
+
+// huge pages in use, frame buffers on hugetlbfs don't show up in /dev/shm
+long hugePagesUsed() {
+    ifstream meminfo("/proc/meminfo");
+    string key;
+    long value, total = 0, free = 0;
+    while(meminfo >> key >> value) {
+        if(key == "HugePages_Total:")
+            total = value;
+        else if(key == "HugePages_Free:")
+            free = value;
+        meminfo.ignore(256, '\n');
+    }
+    return total - free;
+}
+
+// wake-up latency in us below which the given fraction of the wake-ups fell, upper edge of the bucket
+double wakeupPercentile(const WakeupStats & wakeup, double fraction) {
+    int64_t seen = 0;
+    for(int i = 0; i < WAKEUP_BUCKETS; ++i) {
+        seen += wakeup.histogram[i];
+        if(wakeup.count > 0 && seen >= fraction * wakeup.count)
+            return (i + 1) * WAKEUP_BUCKET_US;
+    }
+    return 0.0;
+}
+
+void printCheck(const string & name, double value, double limit, bool & passed) {
+    bool ok = value <= limit;
+    passed = passed && ok;
+    cout << "  " << left << setw(34) << name << right << setw(12) << value << setw(12) << limit << "   " << (ok ? "PASS" : "FAIL") << endl;
+}
+
+// Runs the pipeline unattended for the given time, like cyclictest runs for latency checks of real-time systems.
+// A, B and C measure their wake-up latency (see soak.hpp) and C the longest stall, D samples the memory and CPU usage
+// of the processes and the shared memory in use every second into a CSV log. At the end every measurement is compared
+// with its limit and the pass/fail summary is printed; returns whether all limits were met.
+bool soakRun(atomic<int> childrenPids[], PipelineStats * stats, RobustMutex & mutex, int seconds, const SoakThresholds & limits,
+             const string & logPath) {
+    cout << "Soak run: " << SOAK_WARMUP_S << " s warm-up, then " << seconds << " s measured, log in " << logPath << endl;
+    sleep(SOAK_WARMUP_S);
+
+    //measurements start after the warm-up, startup costs are not part of them
+    int64_t publishedStart = 0, displayedStart = 0;
+    mutex.lock();
+    for(int i = 0; i < stats->streams; ++i) {
+        publishedStart += stats->stream[i].framesPublished;
+        displayedStart += stats->stream[i].framesDisplayed;
+        stats->stream[i].maxFrameGapMs = 0.0;
+    }
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+        stats->process[i].wakeup = WakeupStats();
+    mutex.unlock();
+
+    ofstream log(logPath);
+    log << "seconds,rss_a_kb,rss_b_kb,rss_c_kb,cpu_a,cpu_b,cpu_c,shm_kb,huge_pages,displayed_fps,max_stall_ms" << endl;
+
+    vector<ProcessSample> first(N_OF_SUBPROCESSES), last(N_OF_SUBPROCESSES);
+    //CPU usage (%) of every process in every second of the run
+    vector<vector<double>> cpu(N_OF_SUBPROCESSES);
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+        first[i] = last[i] = sampleProcess(childrenPids[i]);
+    int64_t displayedLast = displayedStart;
+    double maxStallMs = 0.0;
+    string exited;
+    //crashed children are restarted by the supervisor, any restart fails the run
+    int restartsStart[N_OF_SUBPROCESSES];
+    mutex.lock();
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+        restartsStart[i] = stats->process[i].restarts;
+    mutex.unlock();
+
+    for(int elapsed = 1; elapsed <= seconds && exited.empty(); ++elapsed) {
+        sleep(1);
+        int64_t displayed = 0;
+        mutex.lock();
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+            if(stats->process[i].restarts != restartsStart[i])
+                exited += string(exited.empty() ? "" : ", ") + (char)('A' + i);
+        for(int i = 0; i < stats->streams; ++i) {
+            displayed += stats->stream[i].framesDisplayed;
+            maxStallMs = max(maxStallMs, stats->stream[i].maxFrameGapMs);
+        }
+        mutex.unlock();
+
+        log << elapsed;
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+            ProcessSample sample = sampleProcess(childrenPids[i]);
+            cpu[i].push_back((sample.cpuSeconds - last[i].cpuSeconds) * 100.0);
+            last[i] = sample;
+            log << "," << sample.rssKb;
+        }
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+            log << "," << cpu[i].back();
+        log << "," << shmUsedKb() << "," << hugePagesUsed() << "," << displayed - displayedLast << "," << maxStallMs << endl;
+        displayedLast = displayed;
+
+        if(elapsed % SOAK_REPORT_PERIOD_S == 0)
+            cout << "Soak run: " << elapsed << "/" << seconds << " s, " << displayed - displayedStart << " frames displayed, longest stall "
+                 << maxStallMs << " ms" << endl;
+    }
+
+    int64_t published = -publishedStart, displayed = -displayedStart;
+    mutex.lock();
+    PipelineStats * copy = new PipelineStats(*stats);
+    mutex.unlock();
+    for(int i = 0; i < copy->streams; ++i) {
+        published += copy->stream[i].framesPublished;
+        displayed += copy->stream[i].framesDisplayed;
+    }
+
+    bool passed = exited.empty();
+    cout << "Soak run summary:" << endl << fixed << setprecision(2)
+         << "  " << left << setw(34) << "check" << right << setw(12) << "value" << setw(12) << "limit" << "   result" << endl;
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        const WakeupStats & wakeup = copy->process[i].wakeup;
+        string process(1, (char)('A' + i));
+        cout << "  " << process << " wake-ups: " << wakeup.count << ", average " << wakeup.avgUs << " us, max " << wakeup.maxUs << " us" << endl;
+        printCheck(process + " wake-up latency p99 (us)", wakeupPercentile(wakeup, 0.99), limits.maxWakeupUs, passed);
+        printCheck(process + " RSS growth (MB)", (last[i].rssKb - first[i].rssKb) / 1024.0, limits.maxRssGrowthMb, passed);
+        //drift compares the average CPU usage of the first and the last quarter of the run
+        size_t quarter = max((size_t)1, cpu[i].size() / 4);
+        double start = 0.0, end = 0.0;
+        for(size_t s = 0; s < quarter && s < cpu[i].size(); ++s) {
+            start += cpu[i][s] / quarter;
+            end += cpu[i][cpu[i].size() - 1 - s] / quarter;
+        }
+        printCheck(process + " CPU drift (% points)", fabs(end - start), limits.maxCpuDrift, passed);
+    }
+    printCheck("longest stall (ms)", maxStallMs, limits.maxStallMs, passed);
+    printCheck("drop rate", published > 0 ? max(0.0, 1.0 - (double)displayed / published) : 1.0, limits.maxDropRate, passed);
+    cout << "  " << published << " frames published, " << displayed << " displayed" << endl;
+    if(!exited.empty())
+        cout << "  process " << exited << " crashed during the run   FAIL" << endl;
+    cout << "Soak run " << (passed ? "PASSED" : "FAILED") << endl;
+    cout.unsetf(ios::floatfield);
+    delete copy;
+    return passed;
+}
+
+// SOAK RUN END
+// =================================
+
+// =================================
+// SUPERVISOR
+
+// fork + execv a child process with the given command line, returns its PID or -1 when fork failed.
+// D is multithreaded, so the child only calls async-signal-safe functions between fork and execv: the argument
+// vector and the error message are prepared before forking.
+int spawnChild(const vector<string> & arguments) {
+    vector<char*> args;
+    for(const auto & arg : arguments)
+        args.push_back((char*)arg.c_str());
+    args.push_back(NULL);
+    string error = "Error: Could not execv " + arguments[0] + "\n";
+    int pid = fork();
+    if(pid == 0) {
+        execv(args[0], args.data());
+        if(write(STDERR_FILENO, error.c_str(), error.size()) < 0) {}
+        _exit(1);
+    }
+    return pid;
+}
+
+// Watches A, B and C and restarts a child which died while the pipeline runs. The new child gets --reattach, so it
+// opens the frame buffers, faces shmem, mutexes and queues the other processes still use instead of recreating them,
+// and the rest of the pipeline keeps running. Affinity and scheduling of the child are restored (SCHED_DEADLINE once
+// the child runs again, since it is derived from the measured cost). The recovery time ends when C displays the first
+// frame captured after the crash.
+// Exits are noticed through a pidfd of every child right away, or by polling waitpid where pidfds aren't available.
+// The PIDs are shared with the menu and written by the watcher thread, so they are atomic; a child that could not be
+// forked has PID -1 and is forked again every period until the restart limit is reached.
+class Supervisor {
+private:
+    struct Child {
+        int pidfd;
+        //affinity and scheduling last seen, restored after a restart
+        cpu_set_t cpus;
+        //policy of the worker threads, the one setScheduling() gave all threads or SCHED_DEADLINE
+        int policy;
+        int priority;
+        //restarts within the last SUPERVISOR_RESTART_WINDOW_S
+        deque<chrono::steady_clock::time_point> restarts;
+        //time of a crash the pipeline hasn't recovered from yet, 0 when there is none
+        int64_t crashedAtMs;
+        chrono::steady_clock::time_point crashedAt;
+        bool given_up;
+    };
+
+    atomic<int> * pids;
+    const vector<string> * arguments;
+    PipelineStats * stats;
+    RobustMutex & mutex;
+    Child children[N_OF_SUBPROCESSES];
+    atomic<bool> stopping;
+    thread watcher;
+
+    static int pidfd_open(int pid) {
+        return syscall(SYS_pidfd_open, pid, 0);
+    }
+
+    //the policy the work ran in is the one of the worker threads, the main thread of A and C only joins them
+    void remember_settings(int i) {
+        Child & child = children[i];
+        cpu_set_t cpus;
+        if(sched_getaffinity(pids[i], sizeof(cpus), &cpus) != 0)
+            return;
+        mutex.lock();
+        vector<pid_t> threads(stats->process[i].workerTids, stats->process[i].workerTids + stats->process[i].workerThreads);
+        mutex.unlock();
+        //before the workers are registered the main thread is all there is
+        threads.push_back(pids[i]);
+        DeadlineAttr attr;
+        for(pid_t tid : threads) {
+            if(!thread_scheduling(tid, attr))
+                continue;
+            child.cpus = cpus;
+            child.policy = attr.sched_policy;
+            child.priority = attr.sched_priority;
+            return;
+        }
+    }
+
+    //the policy is applied as setScheduling() does it, to every thread of the child; right after the fork that is
+    //only the main thread, so it is applied again once the child runs (check_recovery), like for the originals
+    void restore_scheduling(int i) {
+        Child & child = children[i];
+        if(child.policy == SCHED_DEADLINE)
+            setDeadlineFromStats(pids[i], i, stats, mutex);
+        else if(child.policy != SCHED_OTHER || child.priority != 0)
+            setScheduling(pids[i], child.policy, child.priority);
+    }
+
+    void restart(int i, int status) {
+        Child & child = children[i];
+        char letter = 'A' + i;
+        child.crashedAt = chrono::steady_clock::now();
+        child.crashedAtMs = chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+        if(WIFSIGNALED(status))
+            cerr << "Process " << letter << " killed by signal " << WTERMSIG(status) << " (" << strsignal(WTERMSIG(status)) << ")";
+        else
+            cerr << "Process " << letter << " exited with code " << WEXITSTATUS(status);
+        respawn(i);
+    }
+
+    //forks the child again unless it was restarted too often, continues the line about the child on cerr
+    void respawn(int i) {
+        Child & child = children[i];
+        auto now = chrono::steady_clock::now();
+        while(!child.restarts.empty() && now - child.restarts.front() > chrono::seconds(SUPERVISOR_RESTART_WINDOW_S))
+            child.restarts.pop_front();
+        if(child.restarts.size() >= SUPERVISOR_MAX_RESTARTS) {
+            cerr << ", restarted " << child.restarts.size() << " times in " << SUPERVISOR_RESTART_WINDOW_S << " s, giving up" << endl;
+            child.given_up = true;
+            child.crashedAtMs = 0;
+            return;
+        }
+        child.restarts.push_back(now);
+
+        vector<string> args = arguments[i];
+        args.push_back("--reattach");
+        int pid = spawnChild(args);
+        if(child.pidfd >= 0)
+            close(child.pidfd);
+        child.pidfd = -1;
+        if(pid < 0) {
+            //no PID to signal or wait for, the next period tries again
+            pids[i] = -1;
+            cerr << ", could not fork: " << strerror(errno) << endl;
+            return;
+        }
+        pids[i] = pid;
+        child.pidfd = pidfd_open(pid);
+
+        sched_setaffinity(pid, sizeof(child.cpus), &child.cpus);
+        if(child.policy != SCHED_DEADLINE)
+            restore_scheduling(i);
+        chrono::duration<double, milli> restartTime = chrono::steady_clock::now() - child.crashedAt;
+        cerr << ", restarted as PID " << pid << " in " << restartTime.count() << " ms" << endl;
+
+        mutex.lock();
+        stats->process[i].restarts++;
+        mutex.unlock();
+    }
+
+    //the pipeline has recovered when C displayed a frame captured after the crash
+    void check_recovery(int i) {
+        Child & child = children[i];
+        int64_t lastCaptureMs = 0;
+        mutex.lock();
+        for(int s = 0; s < stats->streams; ++s)
+            lastCaptureMs = max(lastCaptureMs, stats->stream[s].lastCaptureMs);
+        mutex.unlock();
+        if(lastCaptureMs <= child.crashedAtMs)
+            return;
+
+        chrono::duration<double, milli> recovery = chrono::steady_clock::now() - child.crashedAt;
+        child.crashedAtMs = 0;
+        mutex.lock();
+        stats->process[i].recoveryMs = recovery.count();
+        mutex.unlock();
+        cout << "Process " << (char)('A' + i) << " recovered, first censored frame " << recovery.count() << " ms after the crash" << endl;
+        restore_scheduling(i);
+    }
+
+    void watch() {
+        while(!stopping) {
+            vector<pollfd> fds;
+            for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+                if(children[i].pidfd >= 0)
+                    fds.push_back(pollfd{children[i].pidfd, POLLIN, 0});
+            poll(fds.data(), fds.size(), SUPERVISOR_PERIOD_MS);
+
+            for(int i = 0; i < N_OF_SUBPROCESSES && !stopping; ++i) {
+                if(children[i].given_up)
+                    continue;
+                int status;
+                int pid = pids[i];
+                if(pid < 0) {
+                    cerr << "Process " << (char)('A' + i) << " is not running";
+                    respawn(i);
+                }
+                else if(waitpid(pid, &status, WNOHANG) == pid)
+                    restart(i, status);
+                //until the restarted child recovered its scheduling is the one restored, not one to remember
+                else if(children[i].crashedAtMs == 0)
+                    remember_settings(i);
+                if(children[i].crashedAtMs != 0 && pids[i] > 0)
+                    check_recovery(i);
+            }
+        }
+    }
+
+public:
+    Supervisor(atomic<int> childrenPids[], const vector<string> childArgs[], PipelineStats * pipelineStats, RobustMutex & statsMutex) :
+            pids(childrenPids), arguments(childArgs), stats(pipelineStats), mutex(statsMutex), stopping(false) {
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+            children[i].pidfd = pidfd_open(pids[i]);
+            CPU_ZERO(&children[i].cpus);
+            sched_getaffinity(0, sizeof(children[i].cpus), &children[i].cpus);
+            children[i].policy = SCHED_OTHER;
+            children[i].priority = 0;
+            children[i].crashedAtMs = 0;
+            children[i].given_up = false;
+        }
+        watcher = thread(&Supervisor::watch, this);
+    }
+
+    ~Supervisor() {
+        stop();
+    }
+
+    //called before the children are stopped on purpose
+    void stop() {
+        stopping = true;
+        if(watcher.joinable())
+            watcher.join();
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+            if(children[i].pidfd >= 0) {
+                close(children[i].pidfd);
+                children[i].pidfd = -1;
+            }
+    }
+};
+
+// SUPERVISOR END
+// =================================
+
+// usage: D.out [options] [source ...], every source (camera number, video file or "synthetic") becomes a separate
+// stream, without sources the default camera is used (the synthetic source in soak runs)
 int main(int argc, char const *argv[])
 {
 
+    vector<string> sources;
+    string profile;
+    int soakSeconds = 0;
+    string soakLog;
+    SoakThresholds soakLimits;
+
+    namespace po = boost::program_options;
+    po::options_description options("Options");
+    options.add_options()
+        ("help", "show this message")
+        ("source", po::value<vector<string>>(&sources), "camera number or video file, can be repeated")
+        ("profile", po::value<string>(&profile), "scheduling profile saved by the autotuner, applied at startup")
+        ("mlock", "lock memory of A, B and C and prefault their shared memory (requires sudo)")
+        ("perf", "count cycles, instructions, cache misses, branch misses and context switches per frame in A, B and C")
+        ("native-format", po::value<string>()->implicit_value("auto"), "publish frames of cameras in their native format instead of BGR: yuyv, nv12 or auto")
+        ("delta-frames", "A writes only the tiles of a frame that changed since the previous one")
+        ("ab-queue", po::value<string>()->default_value("latest"), "policy of the queues A -> B: latest, block or every:<n>")
+        ("bc-queue", po::value<string>()->default_value("latest"), "policy of the queues B -> C, as --ab-queue");
+
+    po::options_description soakOptions("Soak run options");
+    soakOptions.add_options()
+        ("soak", po::value<int>(&soakSeconds), "run unattended for the given seconds and print a pass/fail summary")
+        ("soak-log", po::value<string>(&soakLog)->default_value("soak.csv"), "CSV file with the per second samples")
+        ("soak-max-wakeup-us", po::value<double>(&soakLimits.maxWakeupUs)->default_value(2000), "limit of the p99 wake-up latency")
+        ("soak-max-stall-ms", po::value<double>(&soakLimits.maxStallMs)->default_value(1000), "limit of the longest gap between displayed frames")
+        ("soak-max-drop", po::value<double>(&soakLimits.maxDropRate)->default_value(0.1), "limit of the share of frames never displayed")
+        ("soak-max-rss-growth-mb", po::value<double>(&soakLimits.maxRssGrowthMb)->default_value(50), "limit of the memory growth of a process")
+        ("soak-max-cpu-drift", po::value<double>(&soakLimits.maxCpuDrift)->default_value(10), "limit of the CPU usage change of a process");
+    options.add(soakOptions);
+
+    //options of the face detector are only passed on to process B, which checks and interprets them
+    po::options_description detectorOptions("Detector options (passed to process B)");
+    detectorOptions.add_options()
+        ("detector", po::value<string>(), "face detector backend: caffe, onnx, haar or lbp")
+        ("model", po::value<string>(), "model file: caffemodel, onnx model or cascade xml")
+        ("config", po::value<string>(), "network configuration file (caffe prototxt)")
+        ("confidence", po::value<string>(), "minimal confidence of a detected face")
+        ("precision", po::value<string>(), "inference precision: fp32, fp16 or int8")
+        ("dnn-backend", po::value<string>(), "dnn backend: opencv, default, openvino or cuda")
+        ("dnn-target", po::value<string>(), "dnn target: cpu, opencl or opencl_fp16")
+        ("quantize", "int8: quantize the network on the reference clip instead of loading a quantized model")
+        ("reference-model", po::value<string>(), "fp32 model a quantized int8 model is checked against")
+        ("threads", po::value<string>(), "number of OpenCV threads")
+        ("reference-clip", po::value<string>(), "video used to check reduced precision against fp32")
+        ("min-agreement", po::value<string>(), "minimal recall and precision relative to fp32")
+        ("motion-gating", po::value<string>(), "reuse faces while at most this share of tiles changed (best with --delta-frames)");
+    options.add(detectorOptions);
+
+    po::positional_options_description positional;
+    positional.add("source", -1);
+    po::variables_map vm;
+    po::store(po::command_line_parser(argc, argv).options(options).positional(positional).run(), vm);
+    po::notify(vm);
+    if(vm.count("help")) {
+        cout << "Usage: D.out [options] [source ...]" << endl << options << endl;
+        return 0;
+    }
+    QueuePolicy queuePolicy;
+    for(const char * queue : {"ab-queue", "bc-queue"}) {
+        if(!parse_queue_policy(vm[queue].as<string>(), queuePolicy)) {
+            cerr << "Error: invalid policy of --" << queue << ": " << vm[queue].as<string>() << endl;
+            return 1;
+        }
+    }
+    //soak runs don't depend on a camera being connected
+    if(soakSeconds > 0 && sources.empty())
+        sources.push_back("synthetic");
+
+    vector<string> detectorArgs;
+    for(const auto & option : detectorOptions.options()) {
+        const string & name = option->long_name();
+        if(vm.count(name)) {
+            detectorArgs.push_back("--" + name);
+            //flags like --quantize have no value
+            if(option->semantic()->max_tokens() > 0)
+                detectorArgs.push_back(vm[name].as<string>());
+        }
+    }
+
+    int nOfStreams = max(1, min((int)sources.size(), MAX_STREAMS));
+    string streamsArg = to_string(nOfStreams);
+
     // =================================
     // INITIAL IPC OBJECTS SETUP BEGIN
 
@@ -264,6 +1308,53 @@ int main(int argc, char const *argv[])
         ~fps_q_remover(){ boost::interprocess::message_queue::remove(FPS_Q_NAME); }
     } fps_remover;
 
+    struct slo_q_remover{
+        slo_q_remover(){ boost::interprocess::message_queue::remove(SLO_Q_NAME); }
+        ~slo_q_remover(){ boost::interprocess::message_queue::remove(SLO_Q_NAME); }
+    } slo_remover;
+
+    struct resolution_q_remover{
+        resolution_q_remover(){ boost::interprocess::message_queue::remove(RESOLUTION_Q_NAME); }
+        ~resolution_q_remover(){ boost::interprocess::message_queue::remove(RESOLUTION_Q_NAME); }
+    } resolution_remover;
+
+    struct detector_q_remover{
+        detector_q_remover(){ boost::interprocess::message_queue::remove(DETECTOR_Q_NAME); }
+        ~detector_q_remover(){ boost::interprocess::message_queue::remove(DETECTOR_Q_NAME); }
+    } detector_remover;
+
+    struct capture_resolution_q_remover{
+        capture_resolution_q_remover(){ boost::interprocess::message_queue::remove(CAPTURE_RESOLUTION_Q_NAME); }
+        ~capture_resolution_q_remover(){ boost::interprocess::message_queue::remove(CAPTURE_RESOLUTION_Q_NAME); }
+    } capture_resolution_remover;
+
+    struct numa_q_remover{
+        numa_q_remover(){ boost::interprocess::message_queue::remove(NUMA_Q_NAME); }
+        ~numa_q_remover(){ boost::interprocess::message_queue::remove(NUMA_Q_NAME); }
+    } numa_remover;
+
+    struct queue_policy_q_remover{
+        queue_policy_q_remover(){
+            boost::interprocess::message_queue::remove(AB_POLICY_Q_NAME);
+            boost::interprocess::message_queue::remove(BC_POLICY_Q_NAME);
+        }
+        ~queue_policy_q_remover(){
+            boost::interprocess::message_queue::remove(AB_POLICY_Q_NAME);
+            boost::interprocess::message_queue::remove(BC_POLICY_Q_NAME);
+        }
+    } queue_policy_remover;
+
+    struct stats_remover{
+        stats_remover(){
+            boost::interprocess::shared_memory_object::remove(STATS_SHMEM_NAME);
+            RobustMutex::remove(STATS_MUTEX_NAME);
+        }
+        ~stats_remover(){
+            boost::interprocess::shared_memory_object::remove(STATS_SHMEM_NAME);
+            RobustMutex::remove(STATS_MUTEX_NAME);
+        }
+    } stats_remover;
+
     //queue used to change censure in process C
     boost::interprocess::message_queue censure_mode_mq
          (boost::interprocess::create_only               //only create
@@ -280,47 +1371,141 @@ int main(int argc, char const *argv[])
          ,sizeof(int)               //max message size
          );
 
+    //queue used to set the end-to-end latency target of the rate controller in process A
+    boost::interprocess::message_queue slo_mq
+         (boost::interprocess::create_only
+         ,SLO_Q_NAME
+         ,10
+         ,sizeof(int)
+         );
+
+    //queue used to force the detector input size in process B
+    boost::interprocess::message_queue resolution_mq
+         (boost::interprocess::create_only
+         ,RESOLUTION_Q_NAME
+         ,10
+         ,sizeof(int)
+         );
+
+    //queue used to request another detector from process B
+    boost::interprocess::message_queue detector_mq
+         (boost::interprocess::create_only
+         ,DETECTOR_Q_NAME
+         ,10
+         ,DETECTOR_REQUEST_SIZE
+         );
+
+    //queue used to change the capture resolution in process A
+    boost::interprocess::message_queue capture_resolution_mq
+         (boost::interprocess::create_only
+         ,CAPTURE_RESOLUTION_Q_NAME
+         ,10
+         ,2*sizeof(int)
+         );
+
+    //queue used to tell process A on which NUMA node to place the frame buffers
+    boost::interprocess::message_queue numa_mq
+         (boost::interprocess::create_only
+         ,NUMA_Q_NAME
+         ,10
+         ,sizeof(int)
+         );
+
+    //queues used to set the policy of the queues between the stages in processes A and B
+    boost::interprocess::message_queue ab_policy_mq
+         (boost::interprocess::create_only
+         ,AB_POLICY_Q_NAME
+         ,10
+         ,sizeof(QueuePolicy)
+         );
+    boost::interprocess::message_queue bc_policy_mq
+         (boost::interprocess::create_only
+         ,BC_POLICY_Q_NAME
+         ,10
+         ,sizeof(QueuePolicy)
+         );
+
+    //shmem with measurements of all stages, written by A, B and C
+    RobustMutex mutexStats(boost::interprocess::create_only, STATS_MUTEX_NAME);
+    boost::interprocess::shared_memory_object statsShmem(boost::interprocess::create_only, STATS_SHMEM_NAME, boost::interprocess::read_write);
+    statsShmem.truncate(sizeof(PipelineStats));
+    boost::interprocess::mapped_region statsRegion(statsShmem, boost::interprocess::read_write);
+    PipelineStats * stats = new (statsRegion.get_address()) PipelineStats();
+    stats->streams = nOfStreams;
+
     // INITIAL IPC OBJECTS SETUP END
     // =================================
 
 
-    //array where we will store PIDs of A, B and C
-    int childrenPids[N_OF_SUBPROCESSES];
-    int pid;
-    
-    //fork + execv to start new processes
-    pid = fork();
-    if(pid == 0) {
-        char* args[] = {(char*)"./A.out", NULL};
-        execv(args[0], args);
-        cerr << "Error: Could not execv" << endl;
+    //command lines of A, B and C, also used to restart them
+    vector<string> childArgs[N_OF_SUBPROCESSES];
+    //A gets all the sources
+    childArgs[0] = {"./A.out"};
+    //B gets the detector chosen by the user
+    childArgs[1] = {"./B.out", "--streams", streamsArg};
+    childArgs[1].insert(childArgs[1].end(), detectorArgs.begin(), detectorArgs.end());
+    childArgs[1].push_back("--bc-queue");
+    childArgs[1].push_back(vm["bc-queue"].as<string>());
+    childArgs[2] = {"./C.out", "--streams", streamsArg};
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        if(vm.count("mlock"))
+            childArgs[i].push_back("--mlock");
+        if(vm.count("perf"))
+            childArgs[i].push_back("--perf");
+        if(soakSeconds > 0)
+            childArgs[i].push_back("--soak");
     }
-    childrenPids[0] = pid;
+    if(vm.count("native-format"))
+        childArgs[0].push_back("--native=" + vm["native-format"].as<string>());
+    if(vm.count("delta-frames"))
+        childArgs[0].push_back("--delta");
+    childArgs[0].push_back("--queue=" + vm["ab-queue"].as<string>());
+    for(int i = 0; i < nOfStreams && i < (int)sources.size(); ++i)
+        childArgs[0].push_back(sources[i]);
 
-    sleep(1);
+    //array where we will store PIDs of A, B and C, the supervisor replaces the PID of a restarted child
+    atomic<int> childrenPids[N_OF_SUBPROCESSES];
 
-    pid = fork();
-    if(pid == 0) {
-        char* args[] = {(char*)"./B.out", NULL};
-        execv(args[0], args);
-        cerr << "Error: Could not execv" << endl;
+    //B opens objects created by A and C opens objects created by B
+    for(int i = 0; i < N_OF_SUBPROCESSES; ++i) {
+        if(i > 0)
+            sleep(1);
+        childrenPids[i] = spawnChild(childArgs[i]);
+        if(childrenPids[i] < 0) {
+            cerr << "Error: could not fork process " << (char)('A' + i) << ": " << strerror(errno) << endl;
+            for(int j = 0; j < i; ++j)
+                kill(childrenPids[j], SIGINT);
+            return 1;
+        }
     }
-    childrenPids[1] = pid;
-    
 
-    
-    pid = fork();
-    if(pid == 0) {
-        char* args[] = {(char*)"./C.out", NULL};
-        execv(args[0], args);
-        cerr << "Error: Could not execv" << endl;
+    //crashed children are restarted from now on
+    Supervisor supervisor(childrenPids, childArgs, stats, mutexStats);
+
+    if(!profile.empty()) {
+        SchedulingConfig config;
+        //let the children start before changing their scheduling
+        sleep(1);
+        if(!loadProfile(profile, config) || !applyConfig(config, childrenPids, fps_mq))
+            cerr << "Error: could not apply profile " << profile << endl;
+        else
+            cout << "Applied profile: " << describeConfig(config) << endl;
+    }
+    placeFrameBuffers(childrenPids, numa_mq);
+
+    if(soakSeconds > 0) {
+        bool passed = soakRun(childrenPids, stats, mutexStats, soakSeconds, soakLimits, soakLog);
+        supervisor.stop();
+        for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+            if(childrenPids[i] > 0)
+                kill(childrenPids[i], SIGINT);
+        return passed ? 0 : 1;
     }
-    childrenPids[2] = pid;
 
     //main menu with current affinity and scheduling displayed
     while(true) {
         //system("clear");
-        char option;
+        int option = 0;
         cout << "Current affinity for all processes:" << endl;
         for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
             printAffinity(childrenPids[i]);
@@ -328,30 +1513,57 @@ int main(int argc, char const *argv[])
         cout << "Current scheduling for all processes:" << endl;
         for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
             printScheduling(childrenPids[i]);
+
+        cout << "Pipeline stats:" << endl;
+        printStats(stats, mutexStats);
         
         cout << "1. Change censure" << endl << "2. Change affinity" << endl << "3. Change scheduling" << endl << "4. Set fps cap" << endl << 
-         "5. Exit" << endl;
-        cin >> option;
-        cin.ignore();
+         "5. Set latency target" << endl << "6. Set detector resolution" << endl << "7. Autotune scheduling" << endl << "8. Set capture resolution" << endl << "9. Swap detector" << endl << "10. Set queue policy" << endl << "11. Exit" << endl;
+        if(!(cin >> option))
+            cin.clear();
+        cin.ignore(256, '\n');
         switch(option) {
-            case '1':
+            case 1:
                 changeCensureMenu(censure_mode_mq);
                 break;
-            case '2':
+            case 2:
                 changeAffinityMenu(childrenPids);
+                placeFrameBuffers(childrenPids, numa_mq);
                 break;
-            case '3':
-                changeSchedulingMenu(childrenPids);
+            case 3:
+                changeSchedulingMenu(childrenPids, stats, mutexStats);
                 break;
-            case '4':
+            case 4:
                 changeFpsMenu(fps_mq);
                 break;
-            case '5':
-                for(int i = 0; i < N_OF_SUBPROCESSES; ++i) 
-                    kill(childrenPids[i], SIGINT);
+            case 5:
+                changeLatencySloMenu(slo_mq);
+                break;
+            case 6:
+                changeResolutionMenu(resolution_mq);
+                break;
+            case 7:
+                autotuneMenu(childrenPids, fps_mq, stats, mutexStats);
+                placeFrameBuffers(childrenPids, numa_mq);
+                break;
+            case 8:
+                changeCaptureResolutionMenu(capture_resolution_mq);
+                break;
+            case 9:
+                swapDetectorMenu(detector_mq);
+                break;
+            case 10:
+                changeQueuePolicyMenu(ab_policy_mq, bc_policy_mq);
+                break;
+            case 11:
+                supervisor.stop();
+                //a child the supervisor could not fork again has PID -1, kill(-1) would signal every process of the user
+                for(int i = 0; i < N_OF_SUBPROCESSES; ++i)
+                    if(childrenPids[i] > 0)
+                        kill(childrenPids[i], SIGINT);
                 return 0;
             default:
-                cout << "Invalid option, please select 1-5" << endl;
+                cout << "Invalid option, please select 1-11" << endl;
                 break;
 
         }